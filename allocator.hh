@@ -0,0 +1,423 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+inline namespace memory
+{
+    constexpr VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) noexcept {
+        return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+    }
+    constexpr VkDeviceSize align_down(VkDeviceSize value, VkDeviceSize alignment) noexcept {
+        return alignment <= 1 ? value : value / alignment * alignment;
+    }
+
+    // Buffers and linear images may share a bufferImageGranularity page with each other, but not
+    // with optimal-tiling images; callers say which one they are allocating for.
+    enum class resource_kind { linear, optimal };
+
+    struct memory_block {
+        VkDeviceMemory memory = nullptr;
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        size_t allocations = 0;
+        void* mapped = nullptr;
+        bool dedicated = false;
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges;      // offset -> size, coalesced
+    };
+
+    struct allocation {
+        VkDeviceMemory memory = nullptr;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;         // persistent mapping of [offset, offset + size), if host visible
+        uint32_t memory_type = 0;
+        memory_block* block = nullptr;
+
+        explicit operator bool() const noexcept { return memory != nullptr; }
+    };
+
+    struct allocator_stats {
+        struct type_stats {
+            uint32_t memory_type;
+            size_t blocks;
+            size_t allocations;
+            VkDeviceSize reserved;
+            VkDeviceSize used;
+            VkDeviceSize largest_free;
+        };
+        uint32_t device_allocations = 0;
+        uint32_t max_device_allocations = 0;
+        uint32_t peak_device_allocations = 0;
+        VkDeviceSize peak_reserved = 0;         // high-water mark of vkAllocateMemory bytes
+        std::vector<type_stats> types;
+    };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, allocator_stats const& stats) noexcept {
+        output << "(allocator-stats" << std::endl;
+        output << " (device-allocations " << stats.device_allocations << "/" << stats.max_device_allocations << ")" << std::endl;
+        output << " (peak-device-allocations " << stats.peak_device_allocations << ")" << std::endl;
+        output << " (peak-reserved " << stats.peak_reserved << ")" << std::endl;
+        for (auto const& [type, blocks, allocations, reserved, used, largest_free] : stats.types) {
+            auto const free = reserved - used;
+            // 0: all free space is one contiguous range, ->1: free space is scattered
+            auto const fragmentation = free == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free) / free;
+            output << " (memory-type " << type
+                   << " (blocks " << blocks << ")"
+                   << " (allocations " << allocations << ")"
+                   << " (reserved " << reserved << ")"
+                   << " (used " << used << ")"
+                   << " (fragmentation " << fragmentation << "))" << std::endl;
+        }
+        return output << ")";
+    }
+
+    // Carves buffers and images out of large per-memory-type blocks so the number of live
+    // vkAllocateMemory objects stays far below maxMemoryAllocationCount. Each block keeps an
+    // offset-ordered free list with coalescing; requests larger than half a block get a
+    // dedicated allocation. Host-visible blocks are mapped once, for their whole lifetime.
+    class device_allocator {
+    public:
+        device_allocator(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size = VkDeviceSize(64) << 20)
+            : device(device), block_size(block_size)
+        {
+            vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(physical_device, &props);
+            granularity = props.limits.bufferImageGranularity;
+            atom_size = props.limits.nonCoherentAtomSize;
+            max_allocations = props.limits.maxMemoryAllocationCount;
+            blocks.resize(memory_properties.memoryTypeCount);
+        }
+        device_allocator(device_allocator const&) = delete;
+        device_allocator& operator=(device_allocator const&) = delete;
+        ~device_allocator() {
+            for (auto& type_blocks : blocks) {
+                for (auto& block : type_blocks) {
+                    release(*block);
+                }
+            }
+        }
+
+        uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const {
+            auto best = UINT32_MAX;
+            for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+                auto const flags = memory_properties.memoryTypes[i].propertyFlags;
+                if (!(type_bits & (1u << i)) || (flags & required) != required) continue;
+                if ((flags & preferred) == preferred) return i;
+                if (best == UINT32_MAX) best = i;
+            }
+            if (best == UINT32_MAX) throw std::runtime_error("no suitable memory type...");
+            return best;
+        }
+        bool host_coherent(uint32_t memory_type) const noexcept {
+            return memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        }
+        VkDeviceSize non_coherent_atom_size() const noexcept { return atom_size; }
+
+        allocation allocate(VkMemoryRequirements requirements,
+                            VkMemoryPropertyFlags required,
+                            resource_kind kind,
+                            VkMemoryPropertyFlags preferred = 0)
+        {
+            auto const type = find_memory_type(requirements.memoryTypeBits, required, preferred);
+            auto alignment = requirements.alignment;
+            auto size = requirements.size;
+            if (kind == resource_kind::optimal) {
+                // optimal images own whole granularity pages, so no linear neighbour can alias them
+                alignment = std::max(alignment, granularity);
+                size = align_up(size, granularity);
+            }
+            if (mapped_type(type) && !host_coherent(type)) {
+                // keep flush/invalidate ranges of neighbours from overlapping
+                alignment = std::max(alignment, atom_size);
+                size = align_up(size, atom_size);
+            }
+
+            std::lock_guard lock(mutex);
+            if (size > block_size / 2) {
+                auto& block = new_block(type, size);
+                block.dedicated = true;
+                block.used = size;
+                block.allocations = 1;
+                block.free_ranges.clear();
+                return { block.memory, 0, size, block.mapped, type, &block };
+            }
+            for (auto& block : blocks[type]) {
+                if (auto result = suballocate(*block, size, alignment)) {
+                    result.memory_type = type;
+                    return result;
+                }
+            }
+            auto result = suballocate(new_block(type, block_size), size, alignment);
+            result.memory_type = type;
+            return result;
+        }
+
+        void free(allocation const& alloc) {
+            if (!alloc) return;
+            std::lock_guard lock(mutex);
+            auto& block = *alloc.block;
+            block.used -= alloc.size;
+            block.allocations -= 1;
+            if (!block.dedicated) {
+                auto [it, inserted] = block.free_ranges.emplace(alloc.offset, alloc.size);
+                if (auto next = std::next(it); next != block.free_ranges.end() && it->first + it->second == next->first) {
+                    it->second += next->second;
+                    block.free_ranges.erase(next);
+                }
+                if (it != block.free_ranges.begin()) {
+                    if (auto prev = std::prev(it); prev->first + prev->second == it->first) {
+                        prev->second += it->second;
+                        block.free_ranges.erase(it);
+                    }
+                }
+            }
+            if (block.used == 0) {
+                trim(alloc.memory_type, block);
+            }
+        }
+
+        allocation bind(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) {
+            VkMemoryRequirements requirements;
+            vkGetBufferMemoryRequirements(device, buffer, &requirements);
+            auto alloc = allocate(requirements, required, resource_kind::linear, preferred);
+            vkBindBufferMemory(device, buffer, alloc.memory, alloc.offset);
+            return alloc;
+        }
+        allocation bind(VkImage image, VkMemoryPropertyFlags required, resource_kind kind = resource_kind::optimal) {
+            VkMemoryRequirements requirements;
+            vkGetImageMemoryRequirements(device, image, &requirements);
+            auto alloc = allocate(requirements, required, kind);
+            vkBindImageMemory(device, image, alloc.memory, alloc.offset);
+            return alloc;
+        }
+
+        // Flush/invalidate [offset, offset + size) of an allocation, widened to nonCoherentAtomSize.
+        // No-ops on coherent memory.
+        void flush(allocation const& alloc, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const noexcept {
+            if (auto range = mapped_range(alloc, offset, size); range.memory != nullptr) {
+                vkFlushMappedMemoryRanges(device, 1, &range);
+            }
+        }
+        void invalidate(allocation const& alloc, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const noexcept {
+            if (auto range = mapped_range(alloc, offset, size); range.memory != nullptr) {
+                vkInvalidateMappedMemoryRanges(device, 1, &range);
+            }
+        }
+
+        allocator_stats stats() const {
+            std::lock_guard lock(mutex);
+            allocator_stats result = {
+                .device_allocations = device_allocations,
+                .max_device_allocations = max_allocations,
+                .peak_device_allocations = peak_allocations,
+                .peak_reserved = peak_reserved,
+            };
+            for (uint32_t type = 0; type < blocks.size(); ++type) {
+                if (blocks[type].empty()) continue;
+                allocator_stats::type_stats stats = { type, blocks[type].size(), 0, 0, 0, 0 };
+                for (auto const& block : blocks[type]) {
+                    stats.reserved += block->size;
+                    stats.used += block->used;
+                    stats.allocations += block->allocations;
+                    for (auto const& [offset, size] : block->free_ranges) {
+                        stats.largest_free = std::max(stats.largest_free, size);
+                    }
+                }
+                result.types.push_back(stats);
+            }
+            return result;
+        }
+
+    private:
+        bool mapped_type(uint32_t type) const noexcept {
+            return memory_properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        }
+
+        memory_block& new_block(uint32_t type, VkDeviceSize size) {
+            if (device_allocations >= max_allocations) {
+                throw std::runtime_error("maxMemoryAllocationCount exceeded...");
+            }
+            VkMemoryAllocateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .allocationSize = size,
+                .memoryTypeIndex = type,
+            };
+            auto block = std::make_unique<memory_block>();
+            if (VK_SUCCESS != vkAllocateMemory(device, &info, nullptr, &block->memory)) {
+                throw std::runtime_error("vkAllocateMemory failed...");
+            }
+            if (mapped_type(type) && VK_SUCCESS != vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped)) {
+                vkFreeMemory(device, block->memory, nullptr);
+                throw std::runtime_error("vkMapMemory failed...");
+            }
+            ++device_allocations;
+            reserved += size;
+            peak_allocations = std::max(peak_allocations, device_allocations);
+            peak_reserved = std::max(peak_reserved, reserved);
+            block->size = size;
+            block->free_ranges.emplace(0, size);
+            return *blocks[type].emplace_back(std::move(block));
+        }
+
+        allocation suballocate(memory_block& block, VkDeviceSize size, VkDeviceSize alignment) {
+            // best fit: the smallest free range that still holds the aligned request
+            auto best = block.free_ranges.end();
+            for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it) {
+                auto const [offset, length] = *it;
+                auto const aligned = align_up(offset, alignment);
+                if (aligned + size > offset + length) continue;
+                if (best == block.free_ranges.end() || length < best->second) best = it;
+            }
+            if (best == block.free_ranges.end()) return { };
+
+            auto const [offset, length] = *best;
+            auto const aligned = align_up(offset, alignment);
+            block.free_ranges.erase(best);
+            if (aligned > offset) {
+                block.free_ranges.emplace(offset, aligned - offset);
+            }
+            if (auto tail = offset + length - (aligned + size); tail > 0) {
+                block.free_ranges.emplace(aligned + size, tail);
+            }
+            block.used += size;
+            block.allocations += 1;
+            return {
+                block.memory,
+                aligned,
+                size,
+                block.mapped ? static_cast<char*>(block.mapped) + aligned : nullptr,
+                0,
+                &block,
+            };
+        }
+
+        // Dedicated blocks go away as soon as they are empty; for pooled blocks one empty block
+        // per type is kept around so a steady alloc/free pattern does not thrash vkAllocateMemory.
+        void trim(uint32_t type, memory_block& block) {
+            auto& type_blocks = blocks[type];
+            if (!block.dedicated) {
+                auto empty = std::count_if(type_blocks.begin(), type_blocks.end(),
+                                           [](auto const& b) { return !b->dedicated && b->used == 0; });
+                if (empty <= 1) return;
+            }
+            auto it = std::find_if(type_blocks.begin(), type_blocks.end(), [&](auto const& b) { return b.get() == &block; });
+            release(block);
+            type_blocks.erase(it);
+        }
+        void release(memory_block& block) noexcept {
+            if (block.mapped) vkUnmapMemory(device, block.memory);
+            vkFreeMemory(device, block.memory, nullptr);
+            --device_allocations;
+            reserved -= block.size;
+        }
+
+        VkMappedMemoryRange mapped_range(allocation const& alloc, VkDeviceSize offset, VkDeviceSize size) const noexcept {
+            if (!alloc.mapped || host_coherent(alloc.memory_type)) return { };
+            if (size == VK_WHOLE_SIZE) size = alloc.size - offset;
+            auto const begin = align_down(alloc.offset + offset, atom_size);
+            auto const end = std::min(align_up(alloc.offset + offset + size, atom_size), alloc.block->size);
+            return {
+                .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                .pNext = nullptr,
+                .memory = alloc.memory,
+                .offset = begin,
+                .size = end - begin,
+            };
+        }
+
+        VkDevice device;
+        VkDeviceSize block_size;
+        VkDeviceSize granularity = 1;
+        VkDeviceSize atom_size = 1;
+        uint32_t max_allocations = 4096;
+        uint32_t device_allocations = 0;
+        uint32_t peak_allocations = 0;
+        VkDeviceSize reserved = 0;
+        VkDeviceSize peak_reserved = 0;
+        VkPhysicalDeviceMemoryProperties memory_properties;
+        std::vector<std::vector<std::unique_ptr<memory_block>>> blocks;     // per memory type
+        mutable std::mutex mutex;
+    };
+
+    // Bump allocator over one backing allocation, reset wholesale (e.g. once per frame).
+    class linear_arena {
+    public:
+        explicit linear_arena(allocation backing) noexcept : backing(backing) { }
+
+        allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16) noexcept {
+            auto const offset = align_up(backing.offset + head, alignment) - backing.offset;
+            if (offset + size > backing.size) return { };
+            head = offset + size;
+            return sub(offset, size);
+        }
+        void reset() noexcept { head = 0; }
+        VkDeviceSize used() const noexcept { return head; }
+        allocation const& memory() const noexcept { return backing; }
+
+    private:
+        allocation sub(VkDeviceSize offset, VkDeviceSize size) const noexcept {
+            auto result = backing;
+            result.offset += offset;
+            result.size = size;
+            result.mapped = backing.mapped ? static_cast<char*>(backing.mapped) + offset : nullptr;
+            return result;
+        }
+
+        allocation backing;
+        VkDeviceSize head = 0;
+    };
+
+    // Ring over one backing allocation for data that lives exactly as long as its frame:
+    // end_frame() marks where the current frame stops, release_frame() hands the oldest marked
+    // frame's space back once its fence has signaled. head/tail are monotonically increasing
+    // byte counters, so full and empty are never ambiguous.
+    class ring_arena {
+    public:
+        explicit ring_arena(allocation backing) noexcept : backing(backing) { }
+
+        allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16) noexcept {
+            auto const capacity = backing.size;
+            auto pos = head;
+            auto phys = align_up(backing.offset + pos % capacity, alignment) - backing.offset;
+            if (phys + size > capacity) {
+                // never split an allocation across the end; skip to the start instead
+                pos += capacity - pos % capacity;
+                phys = align_up(backing.offset, alignment) - backing.offset;
+            }
+            pos += phys - pos % capacity;
+            if (pos + size - tail > capacity) return { };
+            head = pos + size;
+            auto result = backing;
+            result.offset += phys;
+            result.size = size;
+            result.mapped = backing.mapped ? static_cast<char*>(backing.mapped) + phys : nullptr;
+            return result;
+        }
+        void end_frame() { frames.push_back(head); }
+        void release_frame() noexcept {
+            if (frames.empty()) return;
+            tail = frames.front();
+            frames.pop_front();
+        }
+        VkDeviceSize used() const noexcept { return head - tail; }
+        allocation const& memory() const noexcept { return backing; }
+
+    private:
+        allocation backing;
+        VkDeviceSize head = 0;
+        VkDeviceSize tail = 0;
+        std::deque<VkDeviceSize> frames;
+    };
+} // ::memory
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.hh"
+
+inline namespace readback
+{
+    // raw: every frame appended to one stream file (raw_frame_header + tightly packed pixels)
+    // png: one zlib-compressed PNG per frame in a directory; far slower, meant for --capture-every
+    // hash: no pixels at all, only the per-frame hashes
+    enum class capture_format { raw, png, hash };
+
+    inline capture_format parse_capture_format(std::string_view name) {
+        if (name == "raw") return capture_format::raw;
+        if (name == "png") return capture_format::png;
+        if (name == "hash") return capture_format::hash;
+        throw std::runtime_error("unknown capture format: " + std::string(name));
+    }
+    inline char const* name(capture_format format) noexcept {
+        switch (format) {
+        case capture_format::raw: return "raw";
+        case capture_format::png: return "png";
+        case capture_format::hash: return "hash";
+        }
+        return "?";
+    }
+
+    // FNV-1a over little-endian 64-bit words (the tail byte by byte), so hashing keeps up with
+    // the copy; golden files only need it to be stable, not to match a standard digest.
+    inline uint64_t frame_hash(void const* data, size_t size) noexcept {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto p = static_cast<unsigned char const*>(data);
+        for (auto end = p + size / 8 * 8; p != end; p += 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        for (auto end = static_cast<unsigned char const*>(data) + size; p != end; ++p) {
+            hash = (hash ^ *p) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // One record of a raw capture stream, followed by width * height * 4 bytes of pixels.
+    struct raw_frame_header {
+        char magic[4];
+        uint32_t format;            // VkFormat
+        uint32_t width;
+        uint32_t height;
+        uint64_t frame_number;
+        uint64_t hash;
+    };
+    inline constexpr char raw_frame_magic[4] = { 'W', 'V', 'R', 'F' };
+
+    // 8-bit RGBA, rows with the Up filter, deflated at `level` in one IDAT. BGRA is swizzled.
+    inline bool write_png(std::ostream& output, unsigned char const* pixels, uint32_t width, uint32_t height,
+                          bool bgra, int level = Z_BEST_SPEED)
+    {
+        auto const stride = size_t(width) * 4;
+        std::vector<unsigned char> filtered((stride + 1) * height);
+        std::vector<unsigned char> row(stride), previous(stride, 0);
+        for (uint32_t y = 0; y < height; ++y) {
+            std::memcpy(row.data(), pixels + y * stride, stride);
+            if (bgra) {
+                for (size_t x = 0; x < stride; x += 4) std::swap(row[x], row[x + 2]);
+            }
+            auto out = filtered.data() + y * (stride + 1);
+            out[0] = 2;
+            for (size_t x = 0; x < stride; ++x) out[1 + x] = static_cast<unsigned char>(row[x] - previous[x]);
+            row.swap(previous);
+        }
+        uLongf deflated_size = compressBound(filtered.size());
+        std::vector<unsigned char> deflated(deflated_size);
+        if (Z_OK != compress2(deflated.data(), &deflated_size, filtered.data(), filtered.size(), level)) return false;
+
+        auto be32 = [](unsigned char* p, uint32_t v) {
+            p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+        };
+        auto chunk = [&](char const (&type)[5], unsigned char const* data, uint32_t size) {
+            unsigned char header[8];
+            be32(header, size);
+            std::memcpy(header + 4, type, 4);
+            auto crc = crc32(0, header + 4, 4);
+            if (size) crc = crc32(crc, data, size);     // a null buffer would reset it
+            unsigned char trailer[4];
+            be32(trailer, static_cast<uint32_t>(crc));
+            output.write(reinterpret_cast<char const*>(header), 8);
+            output.write(reinterpret_cast<char const*>(data), size);
+            output.write(reinterpret_cast<char const*>(trailer), 4);
+        };
+        static constexpr unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        output.write(reinterpret_cast<char const*>(signature), 8);
+        unsigned char ihdr[13] = { };
+        be32(ihdr, width);
+        be32(ihdr + 4, height);
+        ihdr[8] = 8;                // bit depth
+        ihdr[9] = 6;                // RGBA
+        chunk("IHDR", ihdr, sizeof (ihdr));
+        chunk("IDAT", deflated.data(), static_cast<uint32_t>(deflated_size));
+        chunk("IEND", nullptr, 0);
+        return bool(output);
+    }
+
+    // Readback of presented frames for regression tests. record() appends a copy of the frame's
+    // image into a free host-visible buffer to the frame's own command buffer; begin_frame(slot),
+    // called once the slot's fence has signaled again, hands the slot's buffers to a writer
+    // thread, which hashes and writes them and then returns the buffers to the pool. The render
+    // thread never maps or copies. When the writer falls behind and no buffer is free, record()
+    // waits for one, so the hash sequence does not depend on timing; with `drop_late` the frame
+    // is left out of the capture instead (and counted), for measuring without the stall. Waiting
+    // cannot deadlock: with at least one buffer more than slots, one is always free or with the
+    // writer while a slot records.
+    //
+    // Next to the pixels goes a text file with one line per captured frame,
+    // "<frame> <width> <height> <hash>", which is what a golden comparison diffs. Frames are
+    // 4-byte RGBA or BGRA images.
+    class frame_capture {
+    public:
+        frame_capture(VkDevice device, device_allocator& allocator, std::filesystem::path path,
+                      capture_format format, uint32_t every, size_t slots, size_t buffers, bool drop_late = false)
+            : device(device), allocator(allocator), path(std::move(path)), format(format),
+              every(std::max<uint32_t>(every, 1)), drop_late(drop_late), pending(slots), pool(std::max(buffers, slots + 1))
+        {
+            // record() must not throw once it has recorded the copy
+            for (auto& indices : pending) indices.reserve(pool.size());
+            std::error_code ec;
+            if (format == capture_format::png) {
+                std::filesystem::create_directories(this->path, ec);
+                hashes.open(this->path / "hashes.txt");
+            }
+            else {
+                if (this->path.has_parent_path()) std::filesystem::create_directories(this->path.parent_path(), ec);
+                if (format == capture_format::raw) {
+                    stream.open(this->path, std::ios::binary);
+                    if (!stream) throw std::runtime_error("cannot open " + this->path.string());
+                    auto hash_path = this->path;
+                    hash_path += ".hashes";
+                    hashes.open(hash_path);
+                }
+                else {
+                    hashes.open(this->path);
+                }
+            }
+            if (!hashes) throw std::runtime_error("cannot open the capture hashes next to " + this->path.string());
+            for (uint32_t i = 0; i < pool.size(); ++i) free.push_back(i);
+            writer = std::jthread([this](std::stop_token stop) { write_loop(stop); });
+        }
+        frame_capture(frame_capture const&) = delete;
+        frame_capture& operator=(frame_capture const&) = delete;
+        ~frame_capture() {
+            finish();
+            writer = { };
+            for (auto& b : pool) release(b);
+        }
+
+        bool wants(uint64_t frame_number) const noexcept { return frame_number % every == 0; }
+
+        // After the frame's last write to `image`, which is in `layout` and goes back to it.
+        void record(VkCommandBuffer cmd, size_t slot, uint64_t frame_number,
+                    VkImage image, VkImageLayout layout, VkFormat image_format, VkExtent2D extent)
+        {
+            uint32_t index = 0;
+            {
+                std::unique_lock lock(mutex);
+                if (free.empty() && drop_late) {
+                    ++dropped;
+                    return;
+                }
+                if (free.empty()) {
+                    auto const t0 = std::chrono::steady_clock::now();
+                    returned.wait(lock, [&] { return !free.empty(); });
+                    ++stalls;
+                    stall_time += std::chrono::steady_clock::now() - t0;
+                }
+                index = free.front();
+                free.pop_front();
+            }
+            auto& b = pool[index];
+            auto const size = VkDeviceSize(extent.width) * extent.height * 4;
+            if (b.capacity < size) {
+                // a free buffer is neither on the GPU nor with the writer
+                try {
+                    release(b);
+                    create(b, size);
+                }
+                catch (...) {
+                    // back to the pool, or finish() would wait for it forever
+                    {
+                        std::lock_guard lock(mutex);
+                        free.push_front(index);
+                    }
+                    returned.notify_all();
+                    throw;
+                }
+            }
+            b.frame_number = frame_number;
+            b.format = image_format;
+            b.extent = extent;
+
+            VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            VkImageMemoryBarrier to_transfer = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+                .oldLayout = layout,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = image,
+                .subresourceRange = range,
+            };
+            vkCmdPipelineBarrier(cmd,
+                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &to_transfer);
+            VkBufferImageCopy copy = {
+                .bufferOffset = 0,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+                .imageOffset = { 0, 0, 0 },
+                .imageExtent = { extent.width, extent.height, 1 },
+            };
+            vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, b.buffer, 1, &copy);
+            VkImageMemoryBarrier back = to_transfer;
+            back.srcAccessMask = 0;
+            back.dstAccessMask = 0;
+            back.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            back.newLayout = layout;
+            VkBufferMemoryBarrier to_host = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = b.buffer,
+                .offset = 0,
+                .size = size,
+            };
+            vkCmdPipelineBarrier(cmd,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                                 0, 0, nullptr, 1, &to_host, 1, &back);
+            pending[slot % pending.size()].push_back(index);
+            ++captured;
+        }
+
+        // After the slot's fence wait, before the slot records again.
+        void begin_frame(size_t slot) {
+            auto& ready = pending[slot % pending.size()];
+            if (ready.empty()) return;
+            for (auto index : ready) allocator.invalidate(pool[index].memory);
+            {
+                std::lock_guard lock(mutex);
+                jobs.insert(jobs.end(), ready.begin(), ready.end());
+            }
+            ready.clear();
+            wakeup.notify_one();
+        }
+
+        // Idles the device, hands everything still in flight to the writer and waits for it.
+        void finish() {
+            vkDeviceWaitIdle(device);
+            for (size_t slot = 0; slot < pending.size(); ++slot) begin_frame(slot);
+            std::unique_lock lock(mutex);
+            returned.wait(lock, [&] { return free.size() == pool.size(); });
+            stream.flush();
+            hashes.flush();
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, frame_capture const& capture) noexcept {
+            using ms = std::chrono::duration<double, std::milli>;
+            std::lock_guard lock(capture.mutex);
+            auto const written = std::max<uint64_t>(capture.written, 1);
+            return output << "(frame-capture" << std::endl
+                          << " (path " << capture.path << ")" << std::endl
+                          << " (format " << name(capture.format) << ")" << std::endl
+                          << " (every " << capture.every << ")" << std::endl
+                          << " (buffers " << capture.pool.size() << ")" << std::endl
+                          << " (captured " << capture.captured << ")" << std::endl
+                          << " (written " << capture.written << ")" << std::endl
+                          << " (dropped " << capture.dropped << ")" << std::endl
+                          << " (stalls " << capture.stalls << ")" << std::endl
+                          << " (stall-ms " << ms(capture.stall_time).count() << ")" << std::endl
+                          << " (failed " << capture.failed << ")" << std::endl
+                          << " (bytes " << capture.bytes << ")" << std::endl
+                          << " (write-avg-ms " << ms(capture.write_time).count() / written << ")" << std::endl
+                          << " (last-hash " << std::hex << std::setw(16) << std::setfill('0') << capture.last_hash
+                          << std::dec << std::setfill(' ') << "))";
+        }
+
+    private:
+        struct readback_buffer {
+            VkBuffer buffer = nullptr;
+            allocation memory;
+            VkDeviceSize capacity = 0;
+            uint64_t frame_number = 0;
+            VkFormat format = VK_FORMAT_UNDEFINED;
+            VkExtent2D extent = { };
+        };
+
+        void create(readback_buffer& b, VkDeviceSize size) {
+            VkBufferCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .size = size,
+                .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+            };
+            if (VK_SUCCESS != vkCreateBuffer(device, &info, nullptr, &b.buffer)) {
+                throw std::runtime_error("vkCreateBuffer failed...");
+            }
+            // the host reads every byte of it; cached memory keeps that from crawling
+            b.memory = allocator.bind(b.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            if (!b.memory.mapped) throw std::runtime_error("readback buffer is not mapped...");
+            b.capacity = size;
+        }
+        void release(readback_buffer& b) noexcept {
+            if (b.buffer) vkDestroyBuffer(device, b.buffer, nullptr);
+            if (b.memory) allocator.free(b.memory);
+            b = { };
+        }
+
+        void write_loop(std::stop_token stop) {
+            for (;;) {
+                uint32_t index = 0;
+                {
+                    std::unique_lock lock(mutex);
+                    // drains what is queued even once stop is requested
+                    if (!wakeup.wait(lock, stop, [&] { return !jobs.empty(); })) return;
+                    index = jobs.front();
+                    jobs.pop_front();
+                }
+                auto const t0 = std::chrono::steady_clock::now();
+                auto const& b = pool[index];
+                auto const pixels = static_cast<unsigned char const*>(b.memory.mapped);
+                auto const size = size_t(b.extent.width) * b.extent.height * 4;
+                auto const hash = frame_hash(pixels, size);
+                bool ok = true;
+                if (format == capture_format::raw) {
+                    raw_frame_header header = {
+                        .magic = { },
+                        .format = static_cast<uint32_t>(b.format),
+                        .width = b.extent.width,
+                        .height = b.extent.height,
+                        .frame_number = b.frame_number,
+                        .hash = hash,
+                    };
+                    std::memcpy(header.magic, raw_frame_magic, sizeof (header.magic));
+                    stream.write(reinterpret_cast<char const*>(&header), sizeof (header));
+                    stream.write(reinterpret_cast<char const*>(pixels), static_cast<std::streamsize>(size));
+                    ok = bool(stream);
+                }
+                else if (format == capture_format::png) {
+                    char file[32];
+                    std::snprintf(file, sizeof (file), "frame-%08llu.png", static_cast<unsigned long long>(b.frame_number));
+                    std::ofstream png(path / file, std::ios::binary);
+                    bool const bgra = b.format == VK_FORMAT_B8G8R8A8_UNORM || b.format == VK_FORMAT_B8G8R8A8_SRGB;
+                    ok = png && write_png(png, pixels, b.extent.width, b.extent.height, bgra);
+                }
+                hashes << b.frame_number << ' ' << b.extent.width << ' ' << b.extent.height << ' '
+                       << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << std::setfill(' ') << '\n';
+                auto const elapsed = std::chrono::steady_clock::now() - t0;
+                {
+                    std::lock_guard lock(mutex);
+                    free.push_back(index);
+                    ++written;
+                    failed += !ok;
+                    bytes += format == capture_format::hash ? 0 : size;
+                    write_time += elapsed;
+                    last_hash = hash;
+                }
+                returned.notify_all();
+            }
+        }
+
+        VkDevice device;
+        device_allocator& allocator;
+        std::filesystem::path path;
+        capture_format format;
+        uint32_t every;
+        bool drop_late;
+        std::vector<std::vector<uint32_t>> pending;     // [slot] buffers recorded into by that slot's frame
+        std::vector<readback_buffer> pool;
+        std::ofstream stream;                           // writer thread once it runs
+        std::ofstream hashes;
+        mutable std::mutex mutex;
+        std::deque<uint32_t> free;
+        std::deque<uint32_t> jobs;
+        std::condition_variable_any wakeup;
+        std::condition_variable returned;
+        uint64_t captured = 0;
+        uint64_t written = 0;
+        uint64_t dropped = 0;
+        uint64_t stalls = 0;
+        uint64_t failed = 0;
+        uint64_t bytes = 0;
+        uint64_t last_hash = 0;
+        std::chrono::steady_clock::duration write_time = { };
+        std::chrono::steady_clock::duration stall_time = { };
+        std::jthread writer;
+    };
+} // ::readback
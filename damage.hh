@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+inline namespace damage
+{
+    inline bool empty(VkRect2D const& r) noexcept {
+        return r.extent.width == 0 || r.extent.height == 0;
+    }
+    inline VkRect2D clip(VkRect2D r, VkExtent2D extent) noexcept {
+        auto const x0 = std::clamp<int64_t>(r.offset.x, 0, extent.width);
+        auto const y0 = std::clamp<int64_t>(r.offset.y, 0, extent.height);
+        auto const x1 = std::clamp<int64_t>(int64_t(r.offset.x) + r.extent.width, 0, extent.width);
+        auto const y1 = std::clamp<int64_t>(int64_t(r.offset.y) + r.extent.height, 0, extent.height);
+        return { { int32_t(x0), int32_t(y0) }, { uint32_t(std::max<int64_t>(x1 - x0, 0)), uint32_t(std::max<int64_t>(y1 - y0, 0)) } };
+    }
+    inline VkRect2D bounds(std::span<VkRect2D const> rects) noexcept {
+        if (rects.empty()) return { };
+        int64_t x0 = INT64_MAX, y0 = INT64_MAX, x1 = INT64_MIN, y1 = INT64_MIN;
+        for (auto const& r : rects) {
+            x0 = std::min<int64_t>(x0, r.offset.x);
+            y0 = std::min<int64_t>(y0, r.offset.y);
+            x1 = std::max<int64_t>(x1, int64_t(r.offset.x) + r.extent.width);
+            y1 = std::max<int64_t>(y1, int64_t(r.offset.y) + r.extent.height);
+        }
+        return { { int32_t(x0), int32_t(y0) }, { uint32_t(x1 - x0), uint32_t(y1 - y0) } };
+    }
+
+    // Dirty rectangles per swapchain image. Vulkan has no buffer-age query, so the age of an image
+    // is derived from when we last presented it: an image that is k frames old must be repainted
+    // with the damage of the k - 1 frames after it plus the current one. Images of a new swapchain,
+    // and images older than the kept history, are repainted in full.
+    class damage_tracker {
+    public:
+        explicit damage_tracker(size_t history_limit = 8, size_t rect_limit = 16)
+            : history_limit(history_limit), rect_limit(rect_limit) { }
+
+        void reset(uint32_t image_count, VkExtent2D size) {
+            extent = size;
+            presented_at.assign(image_count, 0);
+            history.clear();
+            current.clear();
+        }
+        VkExtent2D size() const noexcept { return extent; }
+
+        // damage for the frame being built
+        void add(VkRect2D r) {
+            r = clip(r, extent);
+            if (!empty(r)) push(current, r);
+        }
+        void add_full() {
+            current.assign(1, { { 0, 0 }, extent });
+        }
+        std::span<VkRect2D const> frame_damage() const noexcept { return current; }
+
+        // frames since `image` was presented; 0 when its contents are undefined
+        uint64_t age(uint32_t image) const noexcept {
+            auto const at = presented_at[image];
+            return at == 0 ? 0 : frame - at + 1;
+        }
+        // What has to be repainted in `image` for it to show the current frame.
+        std::span<VkRect2D const> region(uint32_t image) {
+            auto const a = age(image);
+            scratch = current;
+            if (a == 0 || a - 1 > history.size()) {
+                scratch.assign(1, { { 0, 0 }, extent });
+            }
+            else {
+                for (auto it = history.end() - (a - 1); it != history.end(); ++it) {
+                    for (auto const& r : *it) push(scratch, r);
+                }
+            }
+            return scratch;
+        }
+        bool full(std::span<VkRect2D const> rects) const noexcept {
+            auto const b = bounds(rects);
+            return b.offset.x == 0 && b.offset.y == 0 && b.extent.width == extent.width && b.extent.height == extent.height
+                && rects.size() == 1;
+        }
+
+        // `repainted` is what was actually drawn into `image` for this frame.
+        void presented(uint32_t image, std::span<VkRect2D const> repainted) {
+            ++frame;
+            presented_at[image] = frame;
+            history.push_back(std::move(current));
+            if (history.size() > history_limit) history.pop_front();
+            current.clear();
+            ++frames;
+            full_redraws += full(repainted);
+            for (auto const& r : repainted) redrawn_pixels += uint64_t(r.extent.width) * r.extent.height;
+            frame_pixels += uint64_t(extent.width) * extent.height;
+        }
+
+        bool incremental_present = false;   // rects are handed to the compositor as VkPresentRegionsKHR
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, damage_tracker const& t) noexcept {
+            auto const ratio = t.frame_pixels ? double(t.redrawn_pixels) / t.frame_pixels : 0.0;
+            return output << "(damage-stats" << std::endl
+                          << " (incremental-present " << (t.incremental_present ? "t" : "nil") << ")" << std::endl
+                          << " (frames " << t.frames << ")" << std::endl
+                          << " (full-redraws " << t.full_redraws << ")" << std::endl
+                          << " (redrawn-pixels " << t.redrawn_pixels << ")" << std::endl
+                          << " (frame-pixels " << t.frame_pixels << ")" << std::endl
+                          << " (redrawn-percent " << ratio * 100 << ")" << std::endl
+                          << " (mb-not-written " << (t.frame_pixels - t.redrawn_pixels) * 4 / 1e6 << "))";
+        }
+
+    private:
+        // Past the limit the rectangles collapse into their bounding box; per-rect cost in the
+        // clear and in the compositor stops paying off well before that.
+        void push(std::vector<VkRect2D>& rects, VkRect2D r) const {
+            rects.push_back(r);
+            if (rects.size() > rect_limit) rects.assign(1, bounds(rects));
+        }
+
+        size_t history_limit;
+        size_t rect_limit;
+        VkExtent2D extent = { };
+        uint64_t frame = 0;
+        std::vector<uint64_t> presented_at;     // frame counter, 0: never
+        std::deque<std::vector<VkRect2D>> history;
+        std::vector<VkRect2D> current;
+        std::vector<VkRect2D> scratch;
+        uint64_t frames = 0;
+        uint64_t full_redraws = 0;
+        uint64_t redrawn_pixels = 0;
+        uint64_t frame_pixels = 0;
+    };
+} // ::damage
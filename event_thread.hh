@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+inline namespace wayland
+{
+    // Owns the only thread that reads the Wayland socket on behalf of the application. It
+    // dispatches the default queue (registry) and every private queue it was given, then blocks in
+    // poll() until the compositor sends more or the destructor wakes it. Other readers (the Vulkan
+    // WSI on its own queue) coexist through the prepare_read/read_events protocol.
+    class event_thread {
+    public:
+        event_thread(wl_display* display,
+                     std::vector<wl_event_queue*> queues,
+                     std::function<void()> after_dispatch = { })
+            : display(display),
+              queues(std::move(queues)),
+              after_dispatch(std::move(after_dispatch)),
+              wake(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        {
+            if (wake < 0) throw std::runtime_error("eventfd failed...");
+            thread = std::jthread([this](std::stop_token stop) { run(stop); });
+        }
+        event_thread(event_thread const&) = delete;
+        event_thread& operator=(event_thread const&) = delete;
+        ~event_thread() {
+            stop();
+            ::close(wake);
+        }
+
+        // Joins the thread; afterwards everything its listeners wrote is visible to the caller.
+        void stop() noexcept {
+            if (!thread.joinable()) return;
+            thread.request_stop();
+            uint64_t one = 1;
+            (void) ::write(wake, &one, sizeof (one));
+            thread.join();
+        }
+
+        // the connection is gone (compositor exit or protocol error); the render loop should stop
+        bool disconnected() const noexcept { return lost.load(std::memory_order_acquire); }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, event_thread const& events) noexcept {
+            return output << "(wayland-thread"
+                          << " (queues " << events.queues.size() << ")"
+                          << " (wakeups " << events.wakeups.load() << ")"
+                          << " (dispatched " << events.dispatched.load() << ")"
+                          << " (disconnected " << (events.disconnected() ? "t" : "nil") << "))";
+        }
+
+    private:
+        // Dispatches whatever is queued; returns the number of events handled, -1 on error.
+        int dispatch_pending() noexcept {
+            int total = wl_display_dispatch_pending(display);
+            if (total < 0) return -1;
+            for (auto queue : queues) {
+                auto n = wl_display_dispatch_queue_pending(display, queue);
+                if (n < 0) return -1;
+                total += n;
+            }
+            return total;
+        }
+
+        void run(std::stop_token stop) noexcept {
+            pollfd fds[2] = {
+                { .fd = wl_display_get_fd(display), .events = POLLIN, .revents = 0 },
+                { .fd = wake, .events = POLLIN, .revents = 0 },
+            };
+            while (!stop.stop_requested()) {
+                auto handled = dispatch_pending();
+                if (handled < 0) break;
+                dispatched.fetch_add(handled, std::memory_order_relaxed);
+                if (after_dispatch) after_dispatch();
+                if (wl_display_prepare_read(display) != 0) continue;
+                // The default queue is empty now, but another reader may have filled a private
+                // queue since we dispatched it; handle that before blocking on the socket.
+                if (auto n = dispatch_pending(); n != 0) {
+                    wl_display_cancel_read(display);
+                    if (n < 0) break;
+                    dispatched.fetch_add(n, std::memory_order_relaxed);
+                    continue;
+                }
+                fds[0].events = POLLIN;
+                if (wl_display_flush(display) < 0 && errno == EAGAIN) fds[0].events |= POLLOUT;
+                if (::poll(fds, 2, -1) < 0) {
+                    wl_display_cancel_read(display);
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                wakeups.fetch_add(1, std::memory_order_relaxed);
+                if (fds[0].revents & POLLIN) {
+                    if (wl_display_read_events(display) < 0) break;
+                }
+                else {
+                    wl_display_cancel_read(display);
+                    if (fds[0].revents & (POLLERR | POLLHUP)) break;
+                }
+            }
+            if (!stop.stop_requested()) {
+                std::cerr << "wayland connection lost: " << wl_display_get_error(display) << std::endl;
+                lost.store(true, std::memory_order_release);
+            }
+        }
+
+        wl_display* display;
+        std::vector<wl_event_queue*> queues;
+        std::function<void()> after_dispatch;
+        int wake;
+        std::atomic<bool> lost = false;
+        std::atomic<uint64_t> wakeups = 0;
+        std::atomic<uint64_t> dispatched = 0;
+        std::jthread thread;
+    };
+} // ::wayland
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+inline namespace profiling
+{
+    // Nanoseconds on the steady clock, the timebase every trace event ends up on.
+    inline int64_t profile_now() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct trace_event {
+        char const* name;       // zone names are string literals, never copied
+        uint32_t track;         // 1: cpu, 2: gpu
+        int64_t begin;
+        int64_t end;
+    };
+
+    // Scoped GPU timing with vkCmdWriteTimestamp pairs in one query pool per frame in flight.
+    // A slot's results are read back when the slot comes around again, i.e. after its fence has
+    // signaled, so vkGetQueryPoolResults never waits and profiling never stalls the queue.
+    //
+    // Ticks become nanoseconds through timestampPeriod. The GPU clock is put on the CPU timeline
+    // with a running lower bound: a frame's first timestamp cannot be earlier than its submit,
+    // so offset >= submit - gpu_begin for every frame, and the largest such bound is kept.
+    //
+    // Without timestamp support on the queue family (timestampValidBits == 0 or no
+    // timestampPeriod) GPU zones time their recording on the CPU instead.
+    class gpu_profiler {
+    public:
+        gpu_profiler(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family,
+                     size_t slots, uint32_t max_zones = 64)
+            : device(device), max_zones(max_zones), frames(slots)
+        {
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(physical_device, &props);
+            period = props.limits.timestampPeriod;
+            uint32_t count = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+            std::vector<VkQueueFamilyProperties> families(count);
+            vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, families.data());
+            valid_bits = queue_family < count ? families[queue_family].timestampValidBits : 0;
+            if (period <= 0.0f || valid_bits == 0) return;
+
+            for (size_t i = 0; i < slots; ++i) {
+                VkQueryPoolCreateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                    .queryCount = 2 * max_zones,
+                    .pipelineStatistics = 0,
+                };
+                VkQueryPool pool = nullptr;
+                if (VK_SUCCESS != vkCreateQueryPool(device, &info, nullptr, &pool)) {
+                    release();
+                    std::cerr << "vkCreateQueryPool failed, gpu zones fall back to cpu timing" << std::endl;
+                    return;
+                }
+                pools.push_back(pool);
+            }
+            results.resize(4 * max_zones);
+        }
+        gpu_profiler(gpu_profiler const&) = delete;
+        gpu_profiler& operator=(gpu_profiler const&) = delete;
+        ~gpu_profiler() { release(); }
+
+        bool gpu_timing() const noexcept { return !pools.empty(); }
+
+        // Right after vkBeginCommandBuffer of the slot whose fence was just waited on: collects
+        // what the slot measured last time round and resets its queries in `cmd`.
+        void begin_frame(VkCommandBuffer cmd, size_t slot) {
+            current = slot;
+            if (!gpu_timing()) return;
+            collect(frames[slot]);
+            vkCmdResetQueryPool(cmd, pools[slot], 0, 2 * max_zones);
+        }
+        // Right before the slot's vkQueueSubmit.
+        void submitted(size_t slot) noexcept {
+            frames[slot].submitted = profile_now();
+        }
+        // After vkDeviceWaitIdle: collects the slots that will not come around again.
+        void flush() {
+            if (!gpu_timing()) return;
+            for (auto& state : frames) collect(state);
+        }
+
+        // A span of the command buffer being recorded; nests. A null profiler makes it a no-op.
+        class zone {
+        public:
+            zone(gpu_profiler* profiler, VkCommandBuffer cmd, char const* name) noexcept
+                : profiler(profiler), cmd(cmd), name(name)
+            {
+                if (!profiler) return;
+                begin = profile_now();
+                auto& state = profiler->frames[profiler->current];
+                if (profiler->gpu_timing() && state.zones.size() < profiler->max_zones) {
+                    index = static_cast<uint32_t>(state.zones.size());
+                    state.zones.push_back(name);
+                    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->pools[profiler->current], 2 * index);
+                }
+            }
+            zone(zone const&) = delete;
+            zone& operator=(zone const&) = delete;
+            ~zone() {
+                if (!profiler) return;
+                if (index != UINT32_MAX) {
+                    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->pools[profiler->current], 2 * index + 1);
+                }
+                else {
+                    profiler->push({ name, 1, begin, profile_now() });
+                }
+            }
+
+        private:
+            gpu_profiler* profiler;
+            VkCommandBuffer cmd;
+            char const* name;
+            int64_t begin = 0;
+            uint32_t index = UINT32_MAX;
+        };
+
+        // CPU work that was already timed by the caller.
+        void cpu_span(char const* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+            auto ns = [](auto tp) { return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count(); };
+            push({ name, 1, ns(begin), ns(end) });
+        }
+
+        // A span of CPU work on the calling thread. A null profiler makes it a no-op.
+        class cpu_zone {
+        public:
+            cpu_zone(gpu_profiler* profiler, char const* name) noexcept
+                : profiler(profiler), name(name), begin(profiler ? profile_now() : 0) { }
+            cpu_zone(cpu_zone const&) = delete;
+            cpu_zone& operator=(cpu_zone const&) = delete;
+            ~cpu_zone() {
+                if (profiler) profiler->push({ name, 1, begin, profile_now() });
+            }
+
+        private:
+            gpu_profiler* profiler;
+            char const* name;
+            int64_t begin;
+        };
+
+        // Chrome trace event format, loads in chrome://tracing and ui.perfetto.dev; flush() first.
+        void write_trace(std::ostream& output) const {
+            auto base = std::numeric_limits<int64_t>::max();
+            for (auto const& e : events) base = std::min(base, e.begin);
+            auto const flags = output.flags();
+            auto const precision = output.precision();
+            output << std::fixed << std::setprecision(3);       // microseconds, to the nanosecond
+            output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+            output << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"cpu\"}}," << std::endl;
+            output << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"gpu\"}}";
+            for (auto const& [name, track, begin, end] : events) {
+                output << "," << std::endl
+                       << "{\"name\": \"" << name << "\", \"cat\": \"" << (track == 2 ? "gpu" : "cpu") << "\""
+                       << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << track
+                       << ", \"ts\": " << (begin - base) / 1e3
+                       << ", \"dur\": " << std::max<int64_t>(end - begin, 0) / 1e3 << "}";
+            }
+            output << std::endl << "]}" << std::endl;
+            output.flags(flags);
+            output.precision(precision);
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, gpu_profiler const& p) noexcept {
+            return output << "(gpu-profiler"
+                          << " (gpu-timing " << (p.gpu_timing() ? "t" : "nil") << ")"
+                          << " (timestamp-period " << p.period << ")"
+                          << " (timestamp-valid-bits " << p.valid_bits << ")"
+                          << " (events " << p.events.size() << ")"
+                          << " (unavailable " << p.unavailable << ")"
+                          << " (dropped " << p.dropped << "))";
+        }
+
+    private:
+        struct slot_state {
+            std::vector<char const*> zones;     // query pair i belongs to zones[i]
+            int64_t submitted = 0;
+        };
+
+        // Past this, events are counted but not kept; about 32MiB of trace.
+        static constexpr size_t max_events = size_t(1) << 20;
+
+        void push(trace_event const& e) {
+            if (events.size() < max_events) events.push_back(e);
+            else ++dropped;
+        }
+
+        int64_t to_ns(uint64_t ticks) const noexcept {
+            auto const mask = valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+            return static_cast<int64_t>(static_cast<double>(ticks & mask) * period);
+        }
+
+        void collect(slot_state& state) {
+            if (state.zones.empty()) return;
+            auto const count = static_cast<uint32_t>(2 * state.zones.size());
+            // [value, availability] per query; VK_NOT_READY only means some pair is missing
+            vkGetQueryPoolResults(device, pools[&state - frames.data()], 0, count,
+                                  results.size() * sizeof (uint64_t), results.data(), 2 * sizeof (uint64_t),
+                                  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            auto gpu_begin = std::numeric_limits<int64_t>::max();
+            for (size_t i = 0; i < state.zones.size(); ++i) {
+                if (results[4 * i + 1]) gpu_begin = std::min(gpu_begin, to_ns(results[4 * i]));
+            }
+            if (gpu_begin != std::numeric_limits<int64_t>::max() && state.submitted != 0) {
+                offset = calibrated ? std::max(offset, state.submitted - gpu_begin) : state.submitted - gpu_begin;
+                calibrated = true;
+            }
+            for (size_t i = 0; i < state.zones.size(); ++i) {
+                if (!results[4 * i + 1] || !results[4 * i + 3] || !calibrated) {
+                    ++unavailable;
+                    continue;
+                }
+                push({ state.zones[i], 2, to_ns(results[4 * i]) + offset, to_ns(results[4 * i + 2]) + offset });
+            }
+            state.zones.clear();
+        }
+
+        void release() noexcept {
+            for (auto pool : pools) vkDestroyQueryPool(device, pool, nullptr);
+            pools.clear();
+        }
+
+        VkDevice device;
+        uint32_t max_zones;
+        float period = 0.0f;
+        uint32_t valid_bits = 0;
+        std::vector<VkQueryPool> pools;         // per slot; empty: cpu-only
+        std::vector<slot_state> frames;
+        std::vector<uint64_t> results;
+        size_t current = 0;
+        int64_t offset = 0;                     // gpu ns -> steady clock ns
+        bool calibrated = false;
+        std::vector<trace_event> events;
+        uint64_t unavailable = 0;
+        uint64_t dropped = 0;
+    };
+} // ::profiling
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.hh"
+
+inline namespace headless
+{
+    // VK_EXT_headless_surface: a VkSurfaceKHR with no window system behind it, so acquire,
+    // present and present-mode blocking run exactly as they do on a wl_surface.
+    inline VkSurfaceKHR create_headless_surface(VkInstance instance) noexcept {
+        auto create = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+            vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+        if (create == nullptr) return nullptr;
+        VkHeadlessSurfaceCreateInfoEXT info = {
+            .sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+            .pNext = nullptr,
+            .flags = 0,
+        };
+        VkSurfaceKHR surface = nullptr;
+        if (VK_SUCCESS != create(instance, &info, nullptr, &surface)) {
+            std::cerr << "vkCreateHeadlessSurfaceEXT failed..." << std::endl;
+            return nullptr;
+        }
+        return surface;
+    }
+
+    // Stand-in for a swapchain when there is no surface at all: one device-local image per frame
+    // in flight, handed out round-robin. Image i is only reused by the frame that waited on the
+    // fence of the frame that last rendered it, so acquire never blocks.
+    class offscreen_images {
+    public:
+        offscreen_images(VkDevice device, device_allocator& allocator, VkFormat format, VkExtent2D extent, uint32_t count)
+            : device(device), allocator(allocator)
+        {
+            for (uint32_t i = 0; i < count; ++i) {
+                VkImageCreateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = format,
+                    .extent = { extent.width, extent.height, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = VK_SAMPLE_COUNT_1_BIT,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .queueFamilyIndexCount = 0,
+                    .pQueueFamilyIndices = nullptr,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                };
+                VkImage image = nullptr;
+                if (VK_SUCCESS != vkCreateImage(device, &info, nullptr, &image)) {
+                    release();
+                    throw std::runtime_error("vkCreateImage failed...");
+                }
+                images.push_back(image);
+                memory.push_back(allocator.bind(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+            }
+        }
+        offscreen_images(offscreen_images const&) = delete;
+        offscreen_images& operator=(offscreen_images const&) = delete;
+        ~offscreen_images() { release(); }
+
+        std::vector<VkImage> const& get() const noexcept { return images; }
+        uint32_t acquire() noexcept { return static_cast<uint32_t>(next++ % images.size()); }
+
+    private:
+        void release() noexcept {
+            for (auto image : images) vkDestroyImage(device, image, nullptr);
+            for (auto const& alloc : memory) allocator.free(alloc);
+            images.clear();
+            memory.clear();
+        }
+
+        VkDevice device;
+        device_allocator& allocator;
+        std::vector<VkImage> images;
+        std::vector<allocation> memory;
+        uint64_t next = 0;
+    };
+
+    // lavapipe rasterizes on its own worker threads, so per-frame CPU cost is process CPU time,
+    // not the render thread's.
+    inline std::chrono::nanoseconds process_cpu_time() noexcept {
+        timespec ts = { };
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+    // Result of one headless run, written as a single JSON object so CI can diff runs.
+    struct bench_report {
+        std::string workload;
+        std::string target;             // "headless-surface" or "offscreen"
+        std::string device;
+        VkExtent2D extent = { };
+        uint32_t frames_in_flight = 0;
+        uint32_t record_threads = 0;    // 0: recorded inline on the render thread
+        uint64_t submits = 0;
+        uint64_t presents = 0;
+        std::chrono::nanoseconds elapsed = { };
+        std::vector<std::chrono::nanoseconds> frame_times;     // one loop iteration, fence wait included
+        std::vector<std::chrono::nanoseconds> cpu_times;       // process CPU time over the same span
+        std::vector<std::chrono::nanoseconds> record_times;    // vkBeginCommandBuffer to vkEndCommandBuffer of the primary
+        allocator_stats memory;
+        long max_rss_kib = 0;
+
+        void finish(device_allocator const& allocator) {
+            memory = allocator.stats();
+            rusage usage = { };
+            getrusage(RUSAGE_SELF, &usage);
+            max_rss_kib = usage.ru_maxrss;
+        }
+    };
+
+    inline void write_json(std::ostream& output, std::string_view str) {
+        output.put('"');
+        for (auto c : str) {
+            if (c == '"' || c == '\\') output.put('\\');
+            if (static_cast<unsigned char>(c) >= 0x20) output.put(c);
+        }
+        output.put('"');
+    }
+    inline void write_json(std::ostream& output, std::vector<std::chrono::nanoseconds> samples) {
+        using ms = std::chrono::duration<double, std::milli>;
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            if (samples.empty()) return 0.0;
+            auto const rank = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+            return ms(samples[rank]).count();
+        };
+        std::chrono::nanoseconds sum = { };
+        for (auto s : samples) sum += s;
+        output << "{\"mean_ms\": " << (samples.empty() ? 0.0 : ms(sum).count() / samples.size())
+               << ", \"p50_ms\": " << percentile(0.50)
+               << ", \"p90_ms\": " << percentile(0.90)
+               << ", \"p99_ms\": " << percentile(0.99)
+               << ", \"max_ms\": " << (samples.empty() ? 0.0 : ms(samples.back()).count()) << "}";
+    }
+    inline void write_json(std::ostream& output, bench_report const& report) {
+        using seconds = std::chrono::duration<double>;
+        auto const frames = report.frame_times.size();
+        output << "{" << std::endl;
+        output << "  \"workload\": "; write_json(output, report.workload); output << "," << std::endl;
+        output << "  \"target\": "; write_json(output, report.target); output << "," << std::endl;
+        output << "  \"device\": "; write_json(output, report.device); output << "," << std::endl;
+        output << "  \"extent\": [" << report.extent.width << ", " << report.extent.height << "]," << std::endl;
+        output << "  \"frames_in_flight\": " << report.frames_in_flight << "," << std::endl;
+        output << "  \"record_threads\": " << report.record_threads << "," << std::endl;
+        output << "  \"frames\": " << frames << "," << std::endl;
+        output << "  \"submits\": " << report.submits << "," << std::endl;
+        output << "  \"presents\": " << report.presents << "," << std::endl;
+        output << "  \"seconds\": " << seconds(report.elapsed).count() << "," << std::endl;
+        output << "  \"fps\": " << frames / std::max(seconds(report.elapsed).count(), 1e-9) << "," << std::endl;
+        output << "  \"frame_time\": "; write_json(output, report.frame_times); output << "," << std::endl;
+        output << "  \"cpu_time\": "; write_json(output, report.cpu_times); output << "," << std::endl;
+        output << "  \"record_time\": "; write_json(output, report.record_times); output << "," << std::endl;
+        output << "  \"memory\": {"
+               << "\"device_allocations_peak\": " << report.memory.peak_device_allocations
+               << ", \"device_bytes_peak\": " << report.memory.peak_reserved
+               << ", \"max_rss_kib\": " << report.max_rss_kib << "}" << std::endl;
+        output << "}" << std::endl;
+    }
+} // ::headless
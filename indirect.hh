@@ -0,0 +1,680 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.hh"
+#include "pipeline_cache.hh"
+#include "upload.hh"
+#include "cull.comp.spv.h"
+#include "object.vert.spv.h"
+#include "object.frag.spv.h"
+
+inline namespace gpu_driven
+{
+    // Column-major, for Vulkan clip space: y points down, depth runs 0..1.
+    struct mat4 {
+        std::array<float, 16> m = { };
+        float& operator()(int row, int col) noexcept { return m[col * 4 + row]; }
+        float operator()(int row, int col) const noexcept { return m[col * 4 + row]; }
+    };
+    inline mat4 operator*(mat4 const& a, mat4 const& b) noexcept {
+        mat4 r;
+        for (int row = 0; row < 4; ++row) {
+            for (int col = 0; col < 4; ++col) {
+                for (int k = 0; k < 4; ++k) r(row, col) += a(row, k) * b(k, col);
+            }
+        }
+        return r;
+    }
+    inline mat4 perspective(float fovy, float aspect, float near, float far) noexcept {
+        auto const f = 1.0f / std::tan(fovy / 2);
+        mat4 r;
+        r(0, 0) = f / aspect;
+        r(1, 1) = -f;
+        r(2, 2) = far / (near - far);
+        r(2, 3) = near * far / (near - far);
+        r(3, 2) = -1.0f;
+        return r;
+    }
+    inline mat4 look_at(std::array<float, 3> eye, std::array<float, 3> center, std::array<float, 3> up) noexcept {
+        auto normalize = [](std::array<float, 3> v) {
+            auto const len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            return std::array { v[0] / len, v[1] / len, v[2] / len };
+        };
+        auto cross = [](std::array<float, 3> a, std::array<float, 3> b) {
+            return std::array { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        };
+        auto dot = [](std::array<float, 3> a, std::array<float, 3> b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+        auto const f = normalize({ center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] });
+        auto const s = normalize(cross(f, up));
+        auto const u = cross(s, f);
+        mat4 r;
+        for (int i = 0; i < 3; ++i) {
+            r(0, i) = s[i];
+            r(1, i) = u[i];
+            r(2, i) = -f[i];
+        }
+        r(0, 3) = -dot(s, eye);
+        r(1, 3) = -dot(u, eye);
+        r(2, 3) = dot(f, eye);
+        r(3, 3) = 1.0f;
+        return r;
+    }
+
+    // Inward-facing planes (a, b, c, d) with unit normals: a point p is inside when
+    // dot(abc, p) + d >= 0 for all six. Extracted from the combined matrix (Gribb/Hartmann).
+    using frustum = std::array<std::array<float, 4>, 6>;
+    inline frustum extract_frustum(mat4 const& view_proj) noexcept {
+        auto row = [&](int r) { return std::array { view_proj(r, 0), view_proj(r, 1), view_proj(r, 2), view_proj(r, 3) }; };
+        auto const r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+        frustum planes;
+        for (int i = 0; i < 4; ++i) {
+            planes[0][i] = r3[i] + r0[i];      // left
+            planes[1][i] = r3[i] - r0[i];      // right
+            planes[2][i] = r3[i] + r1[i];      // top (y down)
+            planes[3][i] = r3[i] - r1[i];      // bottom
+            planes[4][i] = r2[i];              // near, z >= 0
+            planes[5][i] = r3[i] - r2[i];      // far
+        }
+        for (auto& p : planes) {
+            auto const len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            for (auto& c : p) c /= len;
+        }
+        return planes;
+    }
+
+    // std430 layouts shared with shaders/cull.comp and shaders/object.vert.
+    struct object {
+        float sphere[4];        // xyz center, w radius
+        float color[4];
+        uint32_t mesh;
+        uint32_t pad[3];
+    };
+    static_assert(sizeof (object) == 48);
+    struct mesh_range {
+        uint32_t index_count;
+        uint32_t first_index;
+        int32_t vertex_offset;
+        uint32_t pad;
+    };
+
+    inline bool visible(frustum const& planes, object const& o) noexcept {
+        for (auto const& p : planes) {
+            if (p[0] * o.sphere[0] + p[1] * o.sphere[1] + p[2] * o.sphere[2] + p[3] <= -o.sphere[3]) return false;
+        }
+        return true;
+    }
+
+    // gpu: cull.comp writes the draws, one indirect (count) call draws them
+    // cpu_indirect: culled on the CPU into a mapped indirect buffer, one multi-draw call
+    // direct: culled on the CPU, one vkCmdDrawIndexed per visible object
+    enum class draw_path { gpu, cpu_indirect, direct };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, draw_path path) noexcept {
+        switch (path) {
+        case draw_path::gpu:          return output << "gpu";
+        case draw_path::cpu_indirect: return output << "cpu-indirect";
+        case draw_path::direct:       return output << "direct";
+        }
+        return output;
+    }
+
+    // A scene of many small objects (two unit meshes, instanced by object index) drawn without a
+    // per-object CPU cost when the device allows. Per-object data, meshes and geometry live in
+    // device-local buffers filled through the upload ring at construction; the caller submits
+    // the ring and acquires before the first frame. Draw and count buffers exist once per frame
+    // in flight, so culling frame N+1 never races the indirect reads of frame N.
+    //
+    // gpu needs multiDrawIndirect and drawIndirectFirstInstance, and compacts only when
+    // vkCmdDrawIndexedIndirectCountKHR is there (else culled objects draw zero instances);
+    // cpu_indirect needs drawIndirectFirstInstance and issues one call per draw without
+    // multiDrawIndirect; direct always works. Indirect calls are split at maxDrawIndirectCount.
+    class indirect_scene {
+    public:
+        indirect_scene(VkPhysicalDevice physical_device, VkDevice device, device_allocator& allocator,
+                       pipeline_cache& pipelines, upload_ring& uploads, VkRenderPass pass, size_t slots,
+                       std::span<object const> scene_objects)
+            : device(device), allocator(allocator), objects(scene_objects.begin(), scene_objects.end())
+        {
+            VkPhysicalDeviceFeatures features;
+            vkGetPhysicalDeviceFeatures(physical_device, &features);
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physical_device, &properties);
+            multi_draw = features.multiDrawIndirect;
+            first_instance = features.drawIndirectFirstInstance;
+            max_draws = multi_draw ? std::max(properties.limits.maxDrawIndirectCount, 1u) : 1u;
+            draw_indexed_indirect_count = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+            // one count-driven call takes at most maxDrawIndirectCount draws; past that, chunk instead
+            if (objects.size() > max_draws) draw_indexed_indirect_count = nullptr;
+            current_path = supports(draw_path::gpu) ? draw_path::gpu
+                         : supports(draw_path::cpu_indirect) ? draw_path::cpu_indirect : draw_path::direct;
+            try {
+                create_geometry(uploads);
+                create_pipelines(pipelines, pass);
+                create_slots(slots);
+            }
+            catch (...) {
+                release();
+                throw;
+            }
+        }
+        indirect_scene(indirect_scene const&) = delete;
+        indirect_scene& operator=(indirect_scene const&) = delete;
+        ~indirect_scene() { release(); }
+
+        bool supports(draw_path path) const noexcept {
+            switch (path) {
+            case draw_path::gpu:          return multi_draw && first_instance;
+            case draw_path::cpu_indirect: return first_instance;
+            case draw_path::direct:       return true;
+            }
+            return false;
+        }
+        bool compacting() const noexcept { return draw_indexed_indirect_count != nullptr; }
+        draw_path path() const noexcept { return current_path; }
+        void use(draw_path path) {
+            if (!supports(path)) throw std::runtime_error("draw path unsupported on this device...");
+            current_path = path;
+        }
+
+        // Outside the render pass, after the slot's fence wait.
+        void cull(VkCommandBuffer cmd, size_t slot, frustum const& planes) {
+            auto& s = frames[slot];
+            if (current_path != draw_path::gpu) {
+                visible_objects.clear();
+                for (uint32_t i = 0; i < objects.size(); ++i) {
+                    if (visible(planes, objects[i])) visible_objects.push_back(i);
+                }
+                if (current_path == draw_path::cpu_indirect) {
+                    auto commands = static_cast<VkDrawIndexedIndirectCommand*>(s.cpu_draws.memory.mapped);
+                    for (size_t n = 0; n < visible_objects.size(); ++n) {
+                        auto const i = visible_objects[n];
+                        auto const& mesh = meshes[objects[i].mesh];
+                        commands[n] = { mesh.index_count, 1, mesh.first_index, mesh.vertex_offset, i };
+                    }
+                    if (!visible_objects.empty()) {
+                        allocator.flush(s.cpu_draws.memory, 0, visible_objects.size() * sizeof (VkDrawIndexedIndirectCommand));
+                    }
+                }
+                return;
+            }
+            vkCmdFillBuffer(cmd, s.count.buffer, 0, sizeof (uint32_t), 0);
+            VkMemoryBarrier cleared = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            };
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                 1, &cleared, 0, nullptr, 0, nullptr);
+            struct {
+                frustum planes;
+                uint32_t object_count;
+                uint32_t compact;
+            } params = { planes, static_cast<uint32_t>(objects.size()), compacting() };
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_layout, 0, 1, &s.set, 0, nullptr);
+            vkCmdPushConstants(cmd, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof (params), &params);
+            vkCmdDispatch(cmd, static_cast<uint32_t>((objects.size() + 63) / 64), 1, 1);
+            VkMemoryBarrier culled = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            };
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+                                 1, &culled, 0, nullptr, 0, nullptr);
+        }
+
+        // Inside a render pass compatible with the one given at construction.
+        void draw(VkCommandBuffer cmd, size_t slot, mat4 const& view_proj, VkExtent2D extent) {
+            auto& s = frames[slot];
+            VkViewport viewport = { 0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f };
+            VkRect2D scissor = { { 0, 0 }, extent };
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_layout, 0, 1, &s.set, 0, nullptr);
+            vkCmdPushConstants(cmd, draw_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof (view_proj), &view_proj);
+            VkDeviceSize const zero = 0;
+            vkCmdBindVertexBuffers(cmd, 0, 1, &vertices.buffer, &zero);
+            vkCmdBindIndexBuffer(cmd, indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+            constexpr uint32_t stride = sizeof (VkDrawIndexedIndirectCommand);
+            auto multi_draw_indirect = [&](VkBuffer buffer, size_t count) {
+                for (size_t first = 0; first < count; first += max_draws, ++draw_calls) {
+                    auto const n = static_cast<uint32_t>(std::min<size_t>(max_draws, count - first));
+                    vkCmdDrawIndexedIndirect(cmd, buffer, first * stride, n, stride);
+                }
+            };
+            draw_calls = 0;
+            switch (current_path) {
+            case draw_path::gpu:
+                if (compacting()) {
+                    draw_indexed_indirect_count(cmd, s.draws.buffer, 0, s.count.buffer, 0, static_cast<uint32_t>(objects.size()), stride);
+                    draw_calls = 1;
+                }
+                else multi_draw_indirect(s.draws.buffer, objects.size());
+                break;
+            case draw_path::cpu_indirect:
+                multi_draw_indirect(s.cpu_draws.buffer, visible_objects.size());
+                break;
+            case draw_path::direct:
+                for (auto i : visible_objects) {
+                    auto const& mesh = meshes[objects[i].mesh];
+                    vkCmdDrawIndexed(cmd, mesh.index_count, 1, mesh.first_index, mesh.vertex_offset, i);
+                }
+                draw_calls = visible_objects.size();
+                break;
+            }
+        }
+
+        // last frame: draw calls recorded, and objects the CPU found visible (unknown on gpu)
+        size_t last_draw_calls() const noexcept { return draw_calls; }
+        size_t last_visible() const noexcept { return visible_objects.size(); }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, indirect_scene const& scene) noexcept {
+            return output << "(indirect-scene"
+                          << " (objects " << scene.objects.size() << ")"
+                          << " (path " << scene.current_path << ")"
+                          << " (multi-draw-indirect " << (scene.multi_draw ? "t" : "nil") << ")"
+                          << " (draw-indirect-first-instance " << (scene.first_instance ? "t" : "nil") << ")"
+                          << " (draw-indirect-count " << (scene.compacting() ? "t" : "nil") << "))";
+        }
+
+    private:
+        struct buffer {
+            VkBuffer buffer = nullptr;
+            allocation memory;
+        };
+        struct slot_state {
+            buffer draws;           // gpu: written by cull.comp
+            buffer count;
+            buffer cpu_draws;       // cpu_indirect: host-visible
+            VkDescriptorSet set = nullptr;
+        };
+
+        buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required) {
+            VkBufferCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .size = size,
+                .usage = usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+            };
+            buffer result;
+            if (VK_SUCCESS != vkCreateBuffer(device, &info, nullptr, &result.buffer)) {
+                throw std::runtime_error("vkCreateBuffer failed...");
+            }
+            result.memory = allocator.bind(result.buffer, required);
+            return result;
+        }
+        void destroy(buffer& b) noexcept {
+            if (b.buffer) vkDestroyBuffer(device, b.buffer, nullptr);
+            if (b.memory) allocator.free(b.memory);
+            b = { };
+        }
+
+        void create_geometry(upload_ring& uploads) {
+            // a cube and an octahedron, both inside the unit sphere
+            constexpr float c = 0.57735f;
+            constexpr float positions[][3] = {
+                { -c, -c, -c }, { c, -c, -c }, { c, c, -c }, { -c, c, -c },
+                { -c, -c, c }, { c, -c, c }, { c, c, c }, { -c, c, c },
+                { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+            };
+            constexpr uint16_t index_data[] = {
+                0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+                2, 3, 7, 2, 7, 6,  1, 2, 6, 1, 6, 5,  0, 4, 7, 0, 7, 3,
+                0, 2, 4, 0, 4, 3, 0, 5, 2, 0, 3, 5,  1, 4, 2, 1, 3, 4, 1, 2, 5, 1, 5, 3,
+            };
+            meshes = { { 36, 0, 0, 0 }, { 24, 36, 8, 0 } };
+            for (auto const& o : objects) {
+                if (o.mesh >= meshes.size()) throw std::runtime_error("object refers to an unknown mesh...");
+            }
+            auto const object_bytes = objects.size() * sizeof (object);
+            vertices = create_buffer(sizeof (positions), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            indices = create_buffer(sizeof (index_data), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            mesh_buffer = create_buffer(meshes.size() * sizeof (mesh_range), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            object_buffer = create_buffer(object_bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if (!uploads.upload(vertices.buffer, 0, positions, sizeof (positions)) ||
+                !uploads.upload(indices.buffer, 0, index_data, sizeof (index_data)) ||
+                !uploads.upload(mesh_buffer.buffer, 0, meshes.data(), meshes.size() * sizeof (mesh_range)) ||
+                !uploads.upload(object_buffer.buffer, 0, objects.data(), object_bytes))
+            {
+                throw std::runtime_error("upload ring too small for the scene...");
+            }
+        }
+
+        VkShaderModule create_module(std::span<uint32_t const> code) {
+            VkShaderModuleCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .codeSize = code.size_bytes(),
+                .pCode = code.data(),
+            };
+            VkShaderModule module = nullptr;
+            if (VK_SUCCESS != vkCreateShaderModule(device, &info, nullptr, &module)) {
+                throw std::runtime_error("vkCreateShaderModule failed...");
+            }
+            return module;
+        }
+
+        void create_pipelines(pipeline_cache& pipelines, VkRenderPass pass) {
+            VkDescriptorSetLayoutBinding bindings[4];
+            for (uint32_t i = 0; i < 4; ++i) {
+                bindings[i] = {
+                    .binding = i,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .descriptorCount = 1,
+                    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | (i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : 0u),
+                    .pImmutableSamplers = nullptr,
+                };
+            }
+            VkDescriptorSetLayoutCreateInfo set_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .bindingCount = 4,
+                .pBindings = bindings,
+            };
+            if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &set_info, nullptr, &set_layout)) {
+                throw std::runtime_error("vkCreateDescriptorSetLayout failed...");
+            }
+            auto create_layout = [&](VkShaderStageFlags stage, uint32_t push_size) {
+                VkPushConstantRange push = { stage, 0, push_size };
+                VkPipelineLayoutCreateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .setLayoutCount = 1,
+                    .pSetLayouts = &set_layout,
+                    .pushConstantRangeCount = 1,
+                    .pPushConstantRanges = &push,
+                };
+                VkPipelineLayout layout = nullptr;
+                if (VK_SUCCESS != vkCreatePipelineLayout(device, &info, nullptr, &layout)) {
+                    throw std::runtime_error("vkCreatePipelineLayout failed...");
+                }
+                return layout;
+            };
+            cull_layout = create_layout(VK_SHADER_STAGE_COMPUTE_BIT, sizeof (frustum) + 2 * sizeof (uint32_t));
+            draw_layout = create_layout(VK_SHADER_STAGE_VERTEX_BIT, sizeof (mat4));
+
+            auto cull = create_module(cull_comp_spv);
+            cull_pipeline = pipelines.create(VkComputePipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = nullptr,
+                        .flags = 0,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = cull,
+                        .pName = "main",
+                        .pSpecializationInfo = nullptr,
+                    },
+                    .layout = cull_layout,
+                    .basePipelineHandle = nullptr,
+                    .basePipelineIndex = -1,
+                });
+            vkDestroyShaderModule(device, cull, nullptr);
+
+            auto vert = create_module(object_vert_spv);
+            VkShaderModule frag = nullptr;
+            try {
+                frag = create_module(object_frag_spv);
+            }
+            catch (...) {
+                vkDestroyShaderModule(device, vert, nullptr);
+                throw;
+            }
+            VkPipelineShaderStageCreateInfo stages[] = {
+                {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                    .module = vert,
+                    .pName = "main",
+                    .pSpecializationInfo = nullptr,
+                },
+                {
+                    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+                    .module = frag,
+                    .pName = "main",
+                    .pSpecializationInfo = nullptr,
+                },
+            };
+            VkVertexInputBindingDescription binding = { 0, 3 * sizeof (float), VK_VERTEX_INPUT_RATE_VERTEX };
+            VkVertexInputAttributeDescription attribute = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+            VkPipelineVertexInputStateCreateInfo vertex_input = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .vertexBindingDescriptionCount = 1,
+                .pVertexBindingDescriptions = &binding,
+                .vertexAttributeDescriptionCount = 1,
+                .pVertexAttributeDescriptions = &attribute,
+            };
+            VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                .primitiveRestartEnable = VK_FALSE,
+            };
+            VkPipelineViewportStateCreateInfo viewport = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .viewportCount = 1,
+                .pViewports = nullptr,
+                .scissorCount = 1,
+                .pScissors = nullptr,
+            };
+            VkPipelineRasterizationStateCreateInfo rasterization = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .depthClampEnable = VK_FALSE,
+                .rasterizerDiscardEnable = VK_FALSE,
+                .polygonMode = VK_POLYGON_MODE_FILL,
+                .cullMode = VK_CULL_MODE_NONE,
+                .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+                .depthBiasEnable = VK_FALSE,
+                .depthBiasConstantFactor = 0.0f,
+                .depthBiasClamp = 0.0f,
+                .depthBiasSlopeFactor = 0.0f,
+                .lineWidth = 1.0f,
+            };
+            VkPipelineMultisampleStateCreateInfo multisample = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+                .sampleShadingEnable = VK_FALSE,
+                .minSampleShading = 0.0f,
+                .pSampleMask = nullptr,
+                .alphaToCoverageEnable = VK_FALSE,
+                .alphaToOneEnable = VK_FALSE,
+            };
+            VkPipelineColorBlendAttachmentState blend_attachment = {
+                .blendEnable = VK_FALSE,
+                .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+                .colorBlendOp = VK_BLEND_OP_ADD,
+                .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+                .alphaBlendOp = VK_BLEND_OP_ADD,
+                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            };
+            VkPipelineColorBlendStateCreateInfo blend = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .logicOpEnable = VK_FALSE,
+                .logicOp = VK_LOGIC_OP_COPY,
+                .attachmentCount = 1,
+                .pAttachments = &blend_attachment,
+                .blendConstants = { },
+            };
+            VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+            VkPipelineDynamicStateCreateInfo dynamic = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .dynamicStateCount = 2,
+                .pDynamicStates = dynamic_states,
+            };
+            draw_pipeline = pipelines.create(VkGraphicsPipelineCreateInfo {
+                    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stageCount = 2,
+                    .pStages = stages,
+                    .pVertexInputState = &vertex_input,
+                    .pInputAssemblyState = &input_assembly,
+                    .pTessellationState = nullptr,
+                    .pViewportState = &viewport,
+                    .pRasterizationState = &rasterization,
+                    .pMultisampleState = &multisample,
+                    .pDepthStencilState = nullptr,
+                    .pColorBlendState = &blend,
+                    .pDynamicState = &dynamic,
+                    .layout = draw_layout,
+                    .renderPass = pass,
+                    .subpass = 0,
+                    .basePipelineHandle = nullptr,
+                    .basePipelineIndex = -1,
+                });
+            vkDestroyShaderModule(device, frag, nullptr);
+            vkDestroyShaderModule(device, vert, nullptr);
+            if (!cull_pipeline || !draw_pipeline) throw std::runtime_error("indirect scene pipelines failed...");
+        }
+
+        void create_slots(size_t slots) {
+            VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(4 * slots) };
+            VkDescriptorPoolCreateInfo pool_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .maxSets = static_cast<uint32_t>(slots),
+                .poolSizeCount = 1,
+                .pPoolSizes = &pool_size,
+            };
+            if (VK_SUCCESS != vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool)) {
+                throw std::runtime_error("vkCreateDescriptorPool failed...");
+            }
+            auto const draw_bytes = std::max<size_t>(objects.size(), 1) * sizeof (VkDrawIndexedIndirectCommand);
+            frames.resize(slots);
+            for (auto& s : frames) {
+                s.draws = create_buffer(draw_bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                s.count = create_buffer(sizeof (uint32_t),
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                if (supports(draw_path::cpu_indirect)) {
+                    s.cpu_draws = create_buffer(draw_bytes, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+                }
+                VkDescriptorSetAllocateInfo set_info = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                    .pNext = nullptr,
+                    .descriptorPool = descriptor_pool,
+                    .descriptorSetCount = 1,
+                    .pSetLayouts = &set_layout,
+                };
+                if (VK_SUCCESS != vkAllocateDescriptorSets(device, &set_info, &s.set)) {
+                    throw std::runtime_error("vkAllocateDescriptorSets failed...");
+                }
+                VkDescriptorBufferInfo infos[] = {
+                    { object_buffer.buffer, 0, VK_WHOLE_SIZE },
+                    { mesh_buffer.buffer, 0, VK_WHOLE_SIZE },
+                    { s.draws.buffer, 0, VK_WHOLE_SIZE },
+                    { s.count.buffer, 0, VK_WHOLE_SIZE },
+                };
+                VkWriteDescriptorSet writes[4];
+                for (uint32_t i = 0; i < 4; ++i) {
+                    writes[i] = {
+                        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                        .pNext = nullptr,
+                        .dstSet = s.set,
+                        .dstBinding = i,
+                        .dstArrayElement = 0,
+                        .descriptorCount = 1,
+                        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                        .pImageInfo = nullptr,
+                        .pBufferInfo = &infos[i],
+                        .pTexelBufferView = nullptr,
+                    };
+                }
+                vkUpdateDescriptorSets(device, 4, writes, 0, nullptr);
+            }
+        }
+
+        void release() noexcept {
+            for (auto& s : frames) {
+                destroy(s.draws);
+                destroy(s.count);
+                destroy(s.cpu_draws);
+            }
+            frames.clear();
+            if (descriptor_pool) vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+            if (draw_pipeline) vkDestroyPipeline(device, draw_pipeline, nullptr);
+            if (cull_pipeline) vkDestroyPipeline(device, cull_pipeline, nullptr);
+            if (draw_layout) vkDestroyPipelineLayout(device, draw_layout, nullptr);
+            if (cull_layout) vkDestroyPipelineLayout(device, cull_layout, nullptr);
+            if (set_layout) vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+            descriptor_pool = nullptr;
+            draw_pipeline = cull_pipeline = nullptr;
+            draw_layout = cull_layout = nullptr;
+            set_layout = nullptr;
+            destroy(object_buffer);
+            destroy(mesh_buffer);
+            destroy(indices);
+            destroy(vertices);
+        }
+
+        VkDevice device;
+        device_allocator& allocator;
+        std::vector<object> objects;                // CPU copy, for the CPU paths
+        std::vector<mesh_range> meshes;
+        std::vector<uint32_t> visible_objects;      // CPU paths, last cull
+        bool multi_draw = false;
+        bool first_instance = false;
+        uint32_t max_draws = 1;                     // per vkCmdDrawIndexedIndirect
+        PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count = nullptr;
+        draw_path current_path = draw_path::direct;
+        buffer vertices, indices, mesh_buffer, object_buffer;
+        VkDescriptorSetLayout set_layout = nullptr;
+        VkPipelineLayout cull_layout = nullptr;
+        VkPipelineLayout draw_layout = nullptr;
+        VkPipeline cull_pipeline = nullptr;
+        VkPipeline draw_pipeline = nullptr;
+        VkDescriptorPool descriptor_pool = nullptr;
+        std::vector<slot_state> frames;
+        size_t draw_calls = 0;
+    };
+} // ::gpu_driven
@@ -3,9 +3,12 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <array>
+#include <span>
 #include <memory>
 #include <tuple>
 #include <utility>
+#include <type_traits>
 //#include <ranges>
             // std::vector result = images | std::views::transform([&](auto image) {
             //     return safe_ptr(image, [&](auto ptr) {
@@ -13,14 +16,51 @@
             //     });
             // });
 #include <initializer_list>
+#include <poll.h>
+#include <time.h>
+#include <chrono>
+#include <charconv>
+#include <csignal>
+#include <string_view>
+#include <algorithm>
+#include <random>
+#include <numeric>
+#include <cmath>
+#include <semaphore>
+#include <thread>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <future>
+#include <atomic>
 
 #include <wayland-client.h>
 #include "xdg-shell-v6-client.h"
 #include "zwp-tablet-v2-client.h"
+#include "wp-presentation-client.h"
 
 #define VK_USE_PLATFORM_WAYLAND_KHR
 #include <vulkan/vulkan.h>
 
+#include "allocator.hh"
+#include "pipeline_cache.hh"
+#include "tablet.hh"
+#include "event_thread.hh"
+#include "sycl_stage.hh"
+#include "raster.hh"
+#include "shm_backend.hh"
+#include "damage.hh"
+#include "headless.hh"
+#include "gpu_profiler.hh"
+#include "startup.hh"
+#include "recorder.hh"
+#include "upload.hh"
+#include "indirect.hh"
+#include "retire.hh"
+#include "outputs.hh"
+#include "capture.hh"
+#include "fill.comp.spv.h"
+
 inline namespace ext
 {
     template <class Ch, class Tuple, size_t... I>
@@ -69,6 +109,36 @@ INTERN_WL_2(wl_registry)
 INTERN_WL_2(wl_compositor)
 INTERN_WL_2(wl_surface)
 INTERN_WL_2(zxdg_shell_v6);
+INTERN_WL_2(zxdg_surface_v6);
+INTERN_WL_2(zxdg_toplevel_v6);
+INTERN_WL_2(wp_presentation);
+INTERN_WL_2(wl_seat);
+INTERN_WL_2(zwp_tablet_manager_v2);
+INTERN_WL_2(zwp_tablet_seat_v2);
+INTERN_WL_2(wl_shm);
+INTERN_WL_SAFE_PTR(wl_event_queue);
+
+// Device-level Vulkan handles: pointer-sized, destroyed through the retire_queue (retire.hh).
+#define INTERN_VK_SAFE_PTR(vk_handle)                           \
+    inline auto safe_ptr(vk_handle ptr) {                       \
+        return safe_ptr(ptr, retire<vk_handle##_T>());          \
+    }
+
+#define INTERN_VK_2(vk_handle, vk_destroy_function)     \
+    INTERN_VK_DESTROY(vk_handle, vk_destroy_function)   \
+    INTERN_VK_SAFE_PTR(vk_handle)
+
+INTERN_VK_2(VkSwapchainKHR, vkDestroySwapchainKHR)
+INTERN_VK_2(VkCommandPool, vkDestroyCommandPool)
+INTERN_VK_2(VkSemaphore, vkDestroySemaphore)
+INTERN_VK_2(VkFence, vkDestroyFence)
+INTERN_VK_2(VkRenderPass, vkDestroyRenderPass)
+INTERN_VK_2(VkImageView, vkDestroyImageView)
+INTERN_VK_2(VkFramebuffer, vkDestroyFramebuffer)
+INTERN_VK_2(VkDescriptorSetLayout, vkDestroyDescriptorSetLayout)
+INTERN_VK_2(VkPipelineLayout, vkDestroyPipelineLayout)
+INTERN_VK_2(VkPipeline, vkDestroyPipeline)
+static_assert(sizeof (decltype (safe_ptr(VkFence()))) == sizeof (VkFence));
 
 inline namespace vulkan
 {
@@ -99,13 +169,21 @@ inline namespace vulkan
         vkEnumerateInstanceExtensionProperties(layer_name, &count, props.data());
         return props;
     }
+    inline bool has_extension(std::string_view name) {
+        auto props = extensions();
+        return std::any_of(props.begin(), props.end(), [&](auto const& prop) { return name == prop.extensionName; });
+    }
     inline auto extensions(VkPhysicalDevice pdev, char const* layer_name = nullptr) {
         uint32_t count = 0;
         vkEnumerateDeviceExtensionProperties(pdev, layer_name, &count, nullptr);
         std::vector<VkExtensionProperties> props(count);
-        vkEnumerateInstanceExtensionProperties(layer_name, &count, props.data());
+        vkEnumerateDeviceExtensionProperties(pdev, layer_name, &count, props.data());
         return props;
     }
+    inline bool has_extension(VkPhysicalDevice pdev, std::string_view name) {
+        auto props = extensions(pdev);
+        return std::any_of(props.begin(), props.end(), [&](auto const& prop) { return name == prop.extensionName; });
+    }
     template <class Ch>
     inline auto& operator<<(std::basic_ostream<Ch>& output, VkExtensionProperties const& prop) noexcept {
         auto const [name, spec] = prop;
@@ -124,11 +202,25 @@ inline namespace vulkan
         vkGetPhysicalDeviceProperties(pdev, &prop);
         return prop;
     }
+    inline auto queue_families(VkPhysicalDevice pdev) {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(pdev, &count, nullptr);
+        std::vector<VkQueueFamilyProperties> props(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(pdev, &count, props.data());
+        return props;
+    }
     inline auto capabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) noexcept {
         VkSurfaceCapabilitiesKHR caps = { };
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &caps);
         return caps;
     }
+    inline auto present_modes(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, nullptr);
+        std::vector<VkPresentModeKHR> modes(count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &count, modes.data());
+        return modes;
+    }
     template <class Ch>
     inline auto& operator<<(std::basic_ostream<Ch>& output, VkExtent2D const& extent) noexcept {
         return output << '(' << extent.width << ' ' << extent.height << ')';
@@ -270,6 +362,7 @@ inline namespace vulkan
         PRINT_SIG_VAL_PAIR(optimalBufferCopyOffsetAlignment);
         PRINT_SIG_VAL_PAIR(optimalBufferCopyRowPitchAlignment);
         PRINT_SIG_VAL_PAIR(nonCoherentAtomSize);
+#undef PRINT_SIG_VAL_PAIR
         return output << ")";
     }
     template <class Ch>
@@ -289,226 +382,3194 @@ inline namespace vulkan
         //output << prop.sparseProperties...
         return output;
     }
-} // ::vulkan
-
-int main() {
-    // std::cout << "instance layers:" << std::endl;
-    // for (auto const& layer : layers()) {
-    //     std::cout << layer << std::endl;
-    //     for (auto const& extension : extensions(layer.layerName)) {
-    //         std::cout << '\t' << extension << std::endl;
-    //     }
-    // }
-    // std::cout << "instance extensions:" << std::endl;
-    // auto instance_extensions = extensions();
-    // for (auto const& extension : extensions()) {
-    //     std::cout << extension << std::endl;
-    // }
 
-    try {
-        auto display = safe_ptr(wl_display_connect(nullptr));
-        auto registry = safe_ptr(wl_display_get_registry(display.get()));
+    // Result of scoring every physical device and queue family once. Families that do not exist
+    // on the device collapse onto the next best one (transfer -> compute -> graphics), so callers
+    // can always submit to all three and compare family indices to decide whether ownership
+    // transfers and cross-queue semaphores are needed.
+    struct device_selection {
+        VkPhysicalDevice physical_device = nullptr;
+        uint32_t graphics_family = VK_QUEUE_FAMILY_IGNORED;     // graphics + wayland present
+        uint32_t compute_family = VK_QUEUE_FAMILY_IGNORED;      // async compute
+        uint32_t transfer_family = VK_QUEUE_FAMILY_IGNORED;     // dma/copy engine
+        bool timeline_semaphore = false;
+        int score = -1;
 
-        static wl_compositor* compositor_raw = nullptr;
-        static zxdg_shell_v6* shell_raw = nullptr;
-        wl_registry_listener listener = {
-            .global = [](auto, auto registry, auto name, auto interface, auto version) noexcept {
-                if (std::string_view(interface) == wl_compositor_interface.name) {
-                    compositor_raw = (wl_compositor*) wl_registry_bind(registry,
-                                                                       name,
-                                                                       &wl_compositor_interface,
-                                                                       version);
+        auto unique_families() const {
+            std::vector<uint32_t> families = { graphics_family };
+            for (auto family : { compute_family, transfer_family }) {
+                if (std::find(families.begin(), families.end(), family) == families.end()) {
+                    families.push_back(family);
                 }
-                else if (std::string_view(interface) == zxdg_shell_v6_interface.name) {
-                    shell_raw = (zxdg_shell_v6*) wl_registry_bind(registry,
-                                                                  name,
-                                                                  &zxdg_shell_v6_interface,
-                                                                  version);
+            }
+            return families;
+        }
+    };
+    // `presentable(pdev, family)` decides which graphics families can present to the target.
+    template <class Presentable>
+    inline auto select_device(VkInstance instance, Presentable presentable) {
+        device_selection best;
+        for (auto pdev : physical_devices(instance)) {
+            auto const prop = properties(pdev);
+            if (!has_extension(pdev, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) continue;
+
+            device_selection candidate = { .physical_device = pdev };
+            auto const families = queue_families(pdev);
+            auto find_family = [&](auto pred) {
+                for (uint32_t i = 0; i < families.size(); ++i) {
+                    if (families[i].queueCount > 0 && pred(i, families[i].queueFlags)) return i;
                 }
-            },
-            .global_remove = [](auto...) noexcept { },
+                return VK_QUEUE_FAMILY_IGNORED;
+            };
+            candidate.graphics_family = find_family([&](auto i, auto flags) {
+                return (flags & VK_QUEUE_GRAPHICS_BIT) && presentable(pdev, i);
+            });
+            if (candidate.graphics_family == VK_QUEUE_FAMILY_IGNORED) continue;
+            candidate.compute_family = find_family([](auto, auto flags) {
+                return (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT);
+            });
+            candidate.transfer_family = find_family([](auto, auto flags) {
+                return (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+            });
+
+            if (prop.apiVersion >= VK_MAKE_VERSION(1, 2, 0)) {
+                VkPhysicalDeviceTimelineSemaphoreFeatures timeline = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+                    .pNext = nullptr,
+                };
+                VkPhysicalDeviceFeatures2 features = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                    .pNext = &timeline,
+                };
+                vkGetPhysicalDeviceFeatures2(pdev, &features);
+                candidate.timeline_semaphore = timeline.timelineSemaphore;
+            }
+            // Dedicated queues are only worth having if they can be synchronized with the
+            // graphics queue without a host round trip.
+            if (!candidate.timeline_semaphore) {
+                candidate.compute_family = candidate.transfer_family = VK_QUEUE_FAMILY_IGNORED;
+            }
+            if (candidate.compute_family == VK_QUEUE_FAMILY_IGNORED) {
+                candidate.compute_family = candidate.graphics_family;
+            }
+            if (candidate.transfer_family == VK_QUEUE_FAMILY_IGNORED) {
+                candidate.transfer_family = candidate.compute_family;
+            }
+
+            switch (prop.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   candidate.score = 1000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: candidate.score = 500;  break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    candidate.score = 200;  break;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU:            candidate.score = 100;  break;
+            default:                                     candidate.score = 0;    break;
+            }
+            candidate.score += 50 * (candidate.compute_family != candidate.graphics_family);
+            candidate.score += 25 * (candidate.transfer_family != candidate.compute_family);
+            if (candidate.score > best.score) {
+                best = candidate;
+            }
+        }
+        return best;
+    }
+    inline auto select_device(VkInstance instance, wl_display* display) {
+        return select_device(instance, [display](VkPhysicalDevice pdev, uint32_t family) {
+            return VK_TRUE == vkGetPhysicalDeviceWaylandPresentationSupportKHR(pdev, family, display);
+        });
+    }
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, device_selection const& selection) noexcept {
+        output << "(device-selection" << std::endl;
+#define PRINT_SIG_VAL_PAIR(x) (output << " (" #x " " << selection.x << ")" << std::endl)
+        output << " (deviceName " << properties(selection.physical_device).deviceName << ")" << std::endl;
+        PRINT_SIG_VAL_PAIR(score);
+        PRINT_SIG_VAL_PAIR(graphics_family);
+        PRINT_SIG_VAL_PAIR(compute_family);
+        PRINT_SIG_VAL_PAIR(transfer_family);
+        PRINT_SIG_VAL_PAIR(timeline_semaphore);
+#undef PRINT_SIG_VAL_PAIR
+        return output << ")";
+    }
+
+    inline VkInstance create_instance(std::span<char const* const> layers, std::span<char const* const> extensions) {
+        VkApplicationInfo appInfo = {
+            .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+            .pApplicationName = "7171c4bd-43fa-4013-8570-f4649586b618",
+            .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
+            .pEngineName = "No Engine",
+            .engineVersion = VK_MAKE_VERSION(1, 0, 0),
+            .apiVersion = VK_MAKE_VERSION(1, 2, 0),
         };
-        wl_registry_add_listener(registry.get(), &listener, nullptr);
-        wl_display_roundtrip(display.get());
-        auto compositor = safe_ptr(compositor_raw);
-        auto shell = safe_ptr(shell_raw);
-        auto surface = safe_ptr(wl_compositor_create_surface(compositor.get()));
+        VkInstanceCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .pApplicationInfo = &appInfo,
+            .enabledLayerCount = static_cast<uint32_t>(layers.size()),
+            .ppEnabledLayerNames = layers.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+            .ppEnabledExtensionNames = extensions.data(),
+        };
+        VkInstance instance_raw = nullptr;
+        auto ret = vkCreateInstance(&createInfo, nullptr, &instance_raw);
+        if (ret != VK_SUCCESS) {
+            std::cerr << "vkCreateInstance failed: " << ret << std::endl;
+        }
+        return instance_raw;
+    }
 
-        auto create_instance = [] {
-            VkApplicationInfo appInfo = {
-                .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-                .pApplicationName = "7171c4bd-43fa-4013-8570-f4649586b618",
-                .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-                .pEngineName = "No Engine",
-                .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-                .apiVersion = VK_MAKE_VERSION(1, 0, 0),
-            };
-            char const* layers[] = {
-                "VK_LAYER_LUNARG_api_dump",
-            };
-            char const* extensions[] = {
-                "VK_KHR_wayland_surface",
-            };
-            VkInstanceCreateInfo createInfo = {
-                .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+    // VK_EXT_debug_utils messages of error and warning severity, echoed to stderr and counted, so
+    // a run under the validation layer can fail on what it reports (see check-resize). The
+    // callback comes from whichever thread made the offending call.
+    class debug_messenger {
+    public:
+        explicit debug_messenger(VkInstance instance) : instance(instance) {
+            auto create = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
+                vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+            if (create == nullptr) throw std::runtime_error("vkCreateDebugUtilsMessengerEXT is not available...");
+            VkDebugUtilsMessengerCreateInfoEXT info = {
+                .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
                 .pNext = nullptr,
                 .flags = 0,
-                .pApplicationInfo = &appInfo,
-                .enabledLayerCount = std::size(layers),
-                .ppEnabledLayerNames = layers,
-                .enabledExtensionCount = std::size(extensions),
-                .ppEnabledExtensionNames = extensions,
+                .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+                .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+                             | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+                             | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+                .pfnUserCallback = callback,
+                .pUserData = this,
             };
-            VkInstance instance_raw = nullptr;
-            auto ret = vkCreateInstance(&createInfo, nullptr, &instance_raw);
-            if (ret != VK_SUCCESS) {
-                std::cerr << "vkCreateInstance failed: " << ret << std::endl;
+            if (VK_SUCCESS != create(instance, &info, nullptr, &messenger)) {
+                throw std::runtime_error("vkCreateDebugUtilsMessengerEXT failed...");
+            }
+        }
+        debug_messenger(debug_messenger const&) = delete;
+        debug_messenger& operator=(debug_messenger const&) = delete;
+        ~debug_messenger() {
+            auto destroy = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
+                vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+            if (destroy) destroy(instance, messenger, nullptr);
+        }
+
+        uint64_t errors() const noexcept { return error_count.load(std::memory_order_relaxed); }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, debug_messenger const& messenger) noexcept {
+            return output << "(validation-messages"
+                          << " (errors " << messenger.error_count.load() << ")"
+                          << " (warnings " << messenger.warning_count.load() << "))";
+        }
+
+    private:
+        static VKAPI_ATTR VkBool32 VKAPI_CALL callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                                                       VkDebugUtilsMessageTypeFlagsEXT,
+                                                       VkDebugUtilsMessengerCallbackDataEXT const* data,
+                                                       void* user) noexcept
+        {
+            auto self = static_cast<debug_messenger*>(user);
+            bool const error = severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+            (error ? self->error_count : self->warning_count).fetch_add(1, std::memory_order_relaxed);
+            std::cerr << (error ? "validation error: " : "validation warning: ")
+                      << (data && data->pMessage ? data->pMessage : "") << std::endl;
+            return VK_FALSE;
+        }
+
+        VkInstance instance;
+        VkDebugUtilsMessengerEXT messenger = nullptr;
+        std::atomic<uint64_t> error_count = 0;
+        std::atomic<uint64_t> warning_count = 0;
+    };
+
+    // One queue per distinct family of `selection`, timeline semaphores when the device has them.
+    inline VkDevice create_device(device_selection const& selection, std::span<char const* const> extensions) {
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(selection.physical_device, &supportedFeatures);
+        VkPhysicalDeviceFeatures requiredFeatures = {
+            .geometryShader = VK_TRUE,
+            .tessellationShader = VK_TRUE,
+            .multiDrawIndirect = supportedFeatures.multiDrawIndirect,
+            .drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance,
+        };
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .pNext = nullptr,
+            .timelineSemaphore = VK_TRUE,
+        };
+        float const priority = 1.0f;
+        std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos;
+        for (auto family : selection.unique_families()) {
+            deviceQueueCreateInfos.push_back({
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .queueFamilyIndex = family,
+                    .queueCount = 1,
+                    .pQueuePriorities = &priority,
+                });
+        }
+        VkDeviceCreateInfo deviceCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .pNext = selection.timeline_semaphore ? &timelineFeatures : nullptr,
+            .flags = 0,
+            .queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size()),
+            .pQueueCreateInfos = deviceQueueCreateInfos.data(),
+            .enabledLayerCount = 0,
+            .ppEnabledLayerNames = nullptr,
+            .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+            .ppEnabledExtensionNames = extensions.data(),
+            .pEnabledFeatures = &requiredFeatures,
+        };
+        VkDevice device_raw = nullptr;
+        auto ret = vkCreateDevice(selection.physical_device,
+                                  &deviceCreateInfo,
+                                  nullptr,
+                                  &device_raw);
+        if (ret != VK_SUCCESS) {
+            std::cerr << "vkCreateDevice failed: " << ret << std::endl;
+        }
+        return device_raw;
+    }
+
+    inline void destroy_instance(VkInstance instance) { vkDestroyInstance(instance, nullptr); }
+    inline void destroy_device(VkDevice device) { vkDestroyDevice(device, nullptr); }
+
+    // What startup hands the render loop; handles stay empty past the step that failed.
+    struct vulkan_context {
+        decltype (safe_ptr<VkInstance_T, destroy_instance>()) instance = safe_ptr<VkInstance_T, destroy_instance>();
+        std::unique_ptr<debug_messenger> messages;      // --validation; outlives the device, which reports leaks
+        decltype (safe_ptr<VkDevice_T, destroy_device>()) device = safe_ptr<VkDevice_T, destroy_device>();
+        std::unique_ptr<retire_queue> retired;  // before the device goes, drains what the handles below retired
+        device_selection selection;
+        bool external_memory_host = false;      // lets the SYCL stage hand its host allocations to Vulkan without a copy
+        bool incremental_present = false;       // hands per-frame damage to the compositor (wl_surface.damage_buffer in the WSI)
+    };
+
+    // One queue per distinct family; roles that share a family share the VkQueue, so submissions
+    // to it from several threads still need external synchronization.
+    struct device_queues {
+        VkQueue graphics = nullptr;
+        VkQueue compute = nullptr;
+        VkQueue transfer = nullptr;
+    };
+    inline auto get_queues(VkDevice device, device_selection const& selection) noexcept {
+        device_queues queues;
+        vkGetDeviceQueue(device, selection.graphics_family, 0, &queues.graphics);
+        vkGetDeviceQueue(device, selection.compute_family, 0, &queues.compute);
+        vkGetDeviceQueue(device, selection.transfer_family, 0, &queues.transfer);
+        return queues;
+    }
+
+    // Queue family ownership transfer for EXCLUSIVE resources: the release half is recorded on the
+    // source queue, the acquire half on the destination queue, and the two submissions must be
+    // ordered by a semaphore. Within one family only the acquire side's barrier is recorded.
+    template <class Barrier>
+    inline void transfer_ownership(VkCommandBuffer release, VkCommandBuffer acquire,
+                                   Barrier barrier, uint32_t src_family, uint32_t dst_family,
+                                   VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) noexcept
+    {
+        auto record = [](VkCommandBuffer cmd, Barrier const& b, VkPipelineStageFlags src, VkPipelineStageFlags dst) {
+            if constexpr (std::is_same_v<Barrier, VkImageMemoryBarrier>) {
+                vkCmdPipelineBarrier(cmd, src, dst, 0, 0, nullptr, 0, nullptr, 1, &b);
+            }
+            else {
+                vkCmdPipelineBarrier(cmd, src, dst, 0, 0, nullptr, 1, &b, 0, nullptr);
             }
-            return instance_raw;
         };
-        auto instance = safe_ptr(create_instance(), [](auto ptr) { vkDestroyInstance(ptr, nullptr); });
-        for (auto pdev : physical_devices(instance.get())) {
-            std::cout << properties(pdev) << std::endl;
-            for (auto const& layer : vulkan::layers(pdev)) {
-                std::cout << layer << std::endl;
+        if (src_family == dst_family) {
+            barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            record(acquire, barrier, src_stage, dst_stage);
+            return;
+        }
+        barrier.srcQueueFamilyIndex = src_family;
+        barrier.dstQueueFamilyIndex = dst_family;
+        auto release_barrier = barrier;
+        release_barrier.dstAccessMask = 0;
+        record(release, release_barrier, src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        auto acquire_barrier = barrier;
+        acquire_barrier.srcAccessMask = 0;
+        record(acquire, acquire_barrier, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage);
+    }
+
+    inline auto create_timeline_semaphore(VkDevice device, uint64_t initial = 0) noexcept {
+        VkSemaphoreTypeCreateInfo type = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = initial,
+        };
+        VkSemaphoreCreateInfo info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &type,
+            .flags = 0,
+        };
+        VkSemaphore semaphore = nullptr;
+        if (VK_SUCCESS != vkCreateSemaphore(device, &info, nullptr, &semaphore)) {
+            std::cerr << "vkCreateSemaphore (timeline) failed..." << std::endl;
+        }
+        return semaphore;
+    }
+
+    // Submission that mixes binary and timeline semaphores; `value` is ignored for binary ones.
+    // The timeline chain is only attached when a timeline value is actually involved so this
+    // also works on devices without VK_KHR_timeline_semaphore.
+    struct semaphore_wait {
+        VkSemaphore semaphore;
+        uint64_t value;
+        VkPipelineStageFlags stage;
+    };
+    struct semaphore_signal {
+        VkSemaphore semaphore;
+        uint64_t value;
+    };
+    inline auto submit(VkQueue queue,
+                       std::span<VkCommandBuffer const> command_buffers,
+                       std::span<semaphore_wait const> waits,
+                       std::span<semaphore_signal const> signals,
+                       VkFence fence = nullptr)
+    {
+        std::vector<VkSemaphore> wait_semaphores, signal_semaphores;
+        std::vector<VkPipelineStageFlags> wait_stages;
+        std::vector<uint64_t> wait_values, signal_values;
+        bool timeline = false;
+        for (auto const& [semaphore, value, stage] : waits) {
+            wait_semaphores.push_back(semaphore);
+            wait_values.push_back(value);
+            wait_stages.push_back(stage);
+            timeline |= value != 0;
+        }
+        for (auto const& [semaphore, value] : signals) {
+            signal_semaphores.push_back(semaphore);
+            signal_values.push_back(value);
+            timeline |= value != 0;
+        }
+        VkTimelineSemaphoreSubmitInfo timeline_info = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size()),
+            .pWaitSemaphoreValues = wait_values.data(),
+            .signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size()),
+            .pSignalSemaphoreValues = signal_values.data(),
+        };
+        VkSubmitInfo info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = timeline ? &timeline_info : nullptr,
+            .waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size()),
+            .pWaitSemaphores = wait_semaphores.data(),
+            .pWaitDstStageMask = wait_stages.data(),
+            .commandBufferCount = static_cast<uint32_t>(command_buffers.size()),
+            .pCommandBuffers = command_buffers.data(),
+            .signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size()),
+            .pSignalSemaphores = signal_semaphores.data(),
+        };
+        return vkQueueSubmit(queue, 1, &info, fence);
+    }
+} // ::vulkan
+
+inline namespace render
+{
+    using clock = std::chrono::steady_clock;
+
+    // Per-frame CPU accounting for the frames-in-flight loop: `wait` is time spent blocked on the
+    // frame's fence (i.e. the CPU got N frames ahead of the GPU), `acquire` is time inside
+    // vkAcquireNextImageKHR, and `cpu` is everything else (record + submit + present).
+    struct frame_stats {
+        struct sample {
+            clock::duration wait;
+            clock::duration acquire;
+            clock::duration cpu;
+        };
+        uint32_t frames_in_flight = 0;
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        uint64_t dropped = 0;       // frames lost to VK_ERROR_OUT_OF_DATE_KHR on acquire or present
+        uint64_t recreated = 0;     // swapchain rebuilds
+        std::vector<sample> samples;
+
+        void push(clock::duration wait, clock::duration acquire, clock::duration cpu) {
+            samples.push_back({ wait, acquire, cpu });
+        }
+    };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, frame_stats const& stats) noexcept {
+        using us = std::chrono::duration<double, std::micro>;
+        auto const n = std::max<size_t>(stats.samples.size(), 1);
+        clock::duration wait_sum{}, wait_max{}, acquire_sum{}, cpu_sum{}, cpu_max{};
+        size_t stalled = 0;
+        for (auto const& [wait, acquire, cpu] : stats.samples) {
+            wait_sum += wait;
+            wait_max = std::max(wait_max, wait);
+            acquire_sum += acquire;
+            cpu_sum += cpu;
+            cpu_max = std::max(cpu_max, cpu);
+            if (wait > std::chrono::microseconds(50)) ++stalled;
+        }
+        output << "(frame-stats" << std::endl;
+#define PRINT_SIG_EXPR_PAIR(x, v) (output << " (" #x " " << (v) << ")" << std::endl)
+        PRINT_SIG_EXPR_PAIR(frames, stats.samples.size());
+        PRINT_SIG_EXPR_PAIR(frames-in-flight, stats.frames_in_flight);
+        PRINT_SIG_EXPR_PAIR(present-mode, stats.present_mode);
+        PRINT_SIG_EXPR_PAIR(cpu-avg-us, us(cpu_sum / n).count());
+        PRINT_SIG_EXPR_PAIR(cpu-max-us, us(cpu_max).count());
+        PRINT_SIG_EXPR_PAIR(acquire-avg-us, us(acquire_sum / n).count());
+        PRINT_SIG_EXPR_PAIR(wait-avg-us, us(wait_sum / n).count());
+        PRINT_SIG_EXPR_PAIR(wait-max-us, us(wait_max).count());
+        PRINT_SIG_EXPR_PAIR(stalled-frames, stalled);
+        PRINT_SIG_EXPR_PAIR(dropped-frames, stats.dropped);
+        PRINT_SIG_EXPR_PAIR(swapchain-recreations, stats.recreated);
+#undef PRINT_SIG_EXPR_PAIR
+        return output << ")";
+    }
+
+    // Fixed 50us buckets up to 200ms (plus one overflow bucket), so recording is O(1) and
+    // percentiles are exact to the bucket width.
+    struct latency_histogram {
+        static constexpr auto bucket_width = std::chrono::microseconds(50);
+        static constexpr size_t bucket_count = 4000;
+
+        char const* name;
+        std::array<uint64_t, bucket_count + 1> counts = { };
+        uint64_t total = 0;
+        std::chrono::nanoseconds max = { };
+
+        void push(std::chrono::nanoseconds value) noexcept {
+            value = std::max(value, std::chrono::nanoseconds::zero());
+            counts[std::min<size_t>(value / bucket_width, bucket_count)] += 1;
+            total += 1;
+            max = std::max(max, value);
+        }
+        std::chrono::nanoseconds percentile(double p) const noexcept {
+            auto const rank = static_cast<uint64_t>(p * static_cast<double>(total));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                seen += counts[i];
+                if (seen > rank) return std::min<std::chrono::nanoseconds>((i + 1) * bucket_width, max);
+            }
+            return max;
+        }
+    };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, latency_histogram const& histogram) noexcept {
+        using ms = std::chrono::duration<double, std::milli>;
+        return output << "(" << histogram.name
+                      << " (count " << histogram.total << ")"
+                      << " (p50-ms " << ms(histogram.percentile(0.50)).count() << ")"
+                      << " (p99-ms " << ms(histogram.percentile(0.99)).count() << ")"
+                      << " (max-ms " << ms(histogram.max).count() << "))";
+    }
+
+    // Collects wp_presentation feedback. Timestamps are taken on the compositor's presentation
+    // clock so they compare directly with the `presented` event.
+    struct presentation_stats {
+        clockid_t clock = CLOCK_MONOTONIC;
+        uint64_t presented = 0;
+        uint64_t discarded = 0;
+        latency_histogram input_to_present = { "input-to-present" };
+        latency_histogram submit_to_present = { "submit-to-present" };
+
+        std::chrono::nanoseconds now() const noexcept {
+            timespec ts = { };
+            clock_gettime(clock, &ts);
+            return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        }
+    };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, presentation_stats const& stats) noexcept {
+        output << "(presentation-stats" << std::endl;
+        output << " (presented " << stats.presented << ")" << std::endl;
+        output << " (discarded " << stats.discarded << ")" << std::endl;
+        output << " " << stats.input_to_present << std::endl;
+        output << " " << stats.submit_to_present << std::endl;
+        return output << ")";
+    }
+} // ::render
+
+inline namespace bench
+{
+    // Allocate/free throughput of device_allocator against one vkAllocateMemory per object,
+    // using the same log-uniform 256B..256KiB size mix and the same shuffled free order.
+    inline void allocator_benchmark(VkPhysicalDevice pdev, VkDevice device, std::ostream& output) {
+        using seconds = std::chrono::duration<double>;
+        constexpr size_t rounds = 8;
+        auto const count = std::min<size_t>(4096, properties(pdev).limits.maxMemoryAllocationCount / 2);
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> log_size(8.0, 18.0);
+        std::vector<VkDeviceSize> sizes(count);
+        for (auto& size : sizes) size = static_cast<VkDeviceSize>(std::exp2(log_size(rng)));
+        // one shuffled order per round, shared by both phases
+        std::vector<std::vector<size_t>> orders(rounds, std::vector<size_t>(count));
+        for (auto& order : orders) {
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+
+        device_allocator allocator(pdev, device);
+        auto const type = allocator.find_memory_type(UINT32_MAX, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        std::vector<allocation> allocations(count);
+        auto t0 = clock::now();
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < count; ++i) {
+                allocations[i] = allocator.allocate({ sizes[i], 256, 1u << type }, 0, resource_kind::linear);
+            }
+            auto const& order = orders[round];
+            // free half in random order and refill it, to exercise coalescing under fragmentation
+            for (size_t i = 0; i < count / 2; ++i) allocator.free(allocations[order[i]]);
+            for (size_t i = 0; i < count / 2; ++i) {
+                allocations[order[i]] = allocator.allocate({ sizes[order[i]], 256, 1u << type }, 0, resource_kind::linear);
             }
+            if (round == rounds - 1) output << allocator.stats() << std::endl;
+            for (auto i : order) allocator.free(allocations[i]);
         }
+        auto const suballocated = seconds(clock::now() - t0).count();
 
-        auto create_device = [&] {
-            VkPhysicalDeviceFeatures supportedFeatures;
-            vkGetPhysicalDeviceFeatures(physical_devices(instance.get()).front(), &supportedFeatures);
-            VkPhysicalDeviceFeatures requiredFeatures = {
-                .geometryShader = VK_TRUE,
-                .tessellationShader = VK_TRUE,
-                .multiDrawIndirect = supportedFeatures.multiDrawIndirect,
+        std::vector<VkDeviceMemory> memories(count);
+        auto raw_allocate = [&](size_t i) {
+            VkMemoryAllocateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .allocationSize = sizes[i],
+                .memoryTypeIndex = type,
             };
-            VkDeviceQueueCreateInfo deviceQueueCreateInfo = {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            if (VK_SUCCESS != vkAllocateMemory(device, &info, nullptr, &memories[i])) {
+                throw std::runtime_error("vkAllocateMemory failed...");
+            }
+        };
+        t0 = clock::now();
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < count; ++i) raw_allocate(i);
+            auto const& order = orders[round];
+            for (size_t i = 0; i < count / 2; ++i) vkFreeMemory(device, memories[order[i]], nullptr);
+            for (size_t i = 0; i < count / 2; ++i) raw_allocate(order[i]);
+            for (auto i : order) vkFreeMemory(device, memories[i], nullptr);
+        }
+        auto const raw = seconds(clock::now() - t0).count();
+
+        auto const ops = static_cast<double>(rounds * count * 3);    // count + count/2 allocs, as many frees
+        output << "(allocator-benchmark" << std::endl;
+        output << " (objects " << count << ")" << std::endl;
+        output << " (suballocated-ops-per-sec " << ops / suballocated << ")" << std::endl;
+        output << " (vkAllocateMemory-ops-per-sec " << ops / raw << ")" << std::endl;
+        output << " (speedup " << raw / suballocated << "))" << std::endl;
+    }
+
+    // Per-frame cost of getting a SYCL-generated 1080p frame into a device buffer, once through
+    // imported host memory and once through the staging copy. Two slots in flight, like the
+    // render loop, so SYCL work overlaps the previous frame's transfer.
+    inline void sycl_benchmark(VkPhysicalDevice pdev, VkDevice device, device_allocator& allocator,
+                               VkQueue queue, uint32_t family, bool timeline, bool external_memory_host,
+                               std::ostream& output)
+    {
+        using ms = std::chrono::duration<double, std::milli>;
+        constexpr VkExtent2D extent = { 1920, 1080 };
+        constexpr uint64_t frame_count = 240;
+        constexpr size_t slots = 2;
+        auto const size = VkDeviceSize(extent.width) * extent.height * 4;
+
+        VkCommandPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = family,
+        };
+        VkCommandPool pool = nullptr;
+        if (VK_SUCCESS != vkCreateCommandPool(device, &pool_info, nullptr, &pool)) {
+            throw std::runtime_error("vkCreateCommandPool failed...");
+        }
+        auto owned_pool = safe_ptr(pool);
+        VkCommandBuffer commands[slots];
+        VkCommandBufferAllocateInfo command_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .commandPool = pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = slots,
+        };
+        if (VK_SUCCESS != vkAllocateCommandBuffers(device, &command_info, commands)) {
+            throw std::runtime_error("vkAllocateCommandBuffers failed...");
+        }
+        VkFence fences[slots];
+        std::vector<vk_ptr<VkFence_T>> owned_fences;
+        for (auto& fence : fences) {
+            VkFenceCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
                 .pNext = nullptr,
-                .flags = 0,
-                .queueFamilyIndex = 0,
-                .queueCount = 1,
-                .pQueuePriorities = nullptr,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
             };
+            if (VK_SUCCESS != vkCreateFence(device, &info, nullptr, &fence)) {
+                throw std::runtime_error("vkCreateFence failed...");
+            }
+            owned_fences.push_back(safe_ptr(fence));
+        }
+        VkBufferCreateInfo target_info = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .size = size,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+        };
+        VkBuffer target = nullptr;
+        if (VK_SUCCESS != vkCreateBuffer(device, &target_info, nullptr, &target)) {
+            throw std::runtime_error("vkCreateBuffer failed...");
+        }
+        allocation target_memory;
+        // buffers do not go through the retire queue; idle first, the copies may still read it
+        auto owned_target = safe_ptr(target, [&](VkBuffer buffer) noexcept {
+            vkDeviceWaitIdle(device);
+            if (target_memory) allocator.free(target_memory);
+            vkDestroyBuffer(device, buffer, nullptr);
+        });
+        target_memory = allocator.bind(target, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-            char const* extensions[] = {
-                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        auto run = [&](bool zero_copy) {
+            sycl_stage stage(pdev, device, allocator, slots, timeline, zero_copy);
+            auto t0 = clock::now();
+            for (uint64_t frame = 0; frame < frame_count; ++frame) {
+                auto const slot = frame % slots;
+                vkWaitForFences(device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+                vkResetFences(device, 1, &fences[slot]);
+                auto source = stage.produce(slot, extent, frame);
+                VkCommandBufferBeginInfo begin = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                    .pInheritanceInfo = nullptr,
+                };
+                vkBeginCommandBuffer(commands[slot], &begin);
+                VkBufferCopy region = { .srcOffset = 0, .dstOffset = 0, .size = size };
+                vkCmdCopyBuffer(commands[slot], source.buffer, target, 1, &region);
+                vkEndCommandBuffer(commands[slot]);
+                semaphore_wait waits[] = { { source.ready, source.value, VK_PIPELINE_STAGE_TRANSFER_BIT } };
+                if (VK_SUCCESS != submit(queue,
+                                         std::span(&commands[slot], 1),
+                                         std::span(waits, source.ready ? 1 : 0),
+                                         { },
+                                         fences[slot]))
+                {
+                    throw std::runtime_error("vkQueueSubmit failed...");
+                }
+            }
+            vkWaitForFences(device, slots, fences, VK_TRUE, UINT64_MAX);
+            auto const elapsed = ms(clock::now() - t0).count();
+            output << "(sycl-benchmark" << std::endl;
+            output << " (mode " << stage.mode() << ")" << std::endl;
+            output << " (extent " << extent.width << "x" << extent.height << ")" << std::endl;
+            output << " (frames " << frame_count << ")" << std::endl;
+            output << " (ms-per-frame " << elapsed / frame_count << ")" << std::endl;
+            output << " (mb-per-sec " << (size * frame_count / 1e6) / (elapsed / 1e3) << ")" << std::endl;
+            output << " " << stage << ")" << std::endl;
+        };
+        if (external_memory_host) run(true);
+        else output << "(sycl-benchmark (mode zero-copy) (skipped \"VK_EXT_external_memory_host unsupported\"))" << std::endl;
+        run(false);
+    }
+
+    // Mpixels/sec of the software rasterizer's row kernels on a 1080p target, scalar against the
+    // widest set this CPU has, plus a check that both blend to identical bytes.
+    inline void raster_benchmark(std::ostream& output) {
+        using seconds = std::chrono::duration<double>;
+        constexpr int32_t width = 1920;
+        constexpr int32_t height = 1080;
+        constexpr int32_t tile = 256;
+        std::vector<uint32_t> target_pixels(width * height, 0xff000000);
+        std::vector<uint32_t> tile_pixels(tile * tile);
+        std::mt19937 rng(42);
+        for (auto& pixel : tile_pixels) {
+            auto const a = rng() & 0xff;
+            auto channel = [&] { return rng() % (a + 1); };     // premultiplied
+            pixel = (a << 24) | (channel() << 16) | (channel() << 8) | channel();
+        }
+        pixel_view const target = { target_pixels.data(), width, height, width };
+        pixel_view const source = { tile_pixels.data(), tile, tile, tile };
+
+        std::vector<kernels const*> sets = { &scalar_kernels };
+        if (&best_kernels() != &scalar_kernels) sets.push_back(&best_kernels());
+        std::vector<std::vector<uint32_t>> results;
+        for (auto k : sets) {
+            constexpr int fills = 100;
+            constexpr int blits = 2000;
+            auto t0 = clock::now();
+            for (int i = 0; i < fills; ++i) fill(*k, target, { 0, 0, width, height }, 0xff000000u | uint32_t(i));
+            auto t1 = clock::now();
+            for (int i = 0; i < blits; ++i) blit(*k, target, source, (i * 37) % (width - tile), (i * 13) % (height - tile));
+            auto t2 = clock::now();
+            fill(*k, target, { 0, 0, width, height }, 0xff336699);
+            auto t3 = clock::now();
+            for (int i = 0; i < blits; ++i) blit(*k, target, source, (i * 37) % (width - tile), (i * 13) % (height - tile), true);
+            auto t4 = clock::now();
+            results.push_back(target_pixels);
+            auto rate = [](double pixels, clock::duration elapsed) { return pixels / 1e6 / seconds(elapsed).count(); };
+            output << "(raster-benchmark" << std::endl;
+            output << " (kernels " << k->name << ")" << std::endl;
+            output << " (fill-mpix-per-sec " << rate(double(fills) * width * height, t1 - t0) << ")" << std::endl;
+            output << " (copy-mpix-per-sec " << rate(double(blits) * tile * tile, t2 - t1) << ")" << std::endl;
+            output << " (blend-mpix-per-sec " << rate(double(blits) * tile * tile, t4 - t3) << "))" << std::endl;
+        }
+        bool const matches = std::all_of(results.begin(), results.end(), [&](auto const& r) { return r == results.front(); });
+        output << "(raster-kernels-match " << (matches ? "t" : "nil") << ")" << std::endl;
+    }
+
+    // Replays a pen event stream through tablet_input on a producer thread while a consumer
+    // drains it: first as fast as the ring allows (events/sec), then paced at
+    // the stream's own timestamps against a 60Hz consumer (queue latency as the renderer sees it).
+    inline void tablet_benchmark(std::vector<tablet_event> const& stream, std::ostream& output) {
+        using seconds = std::chrono::duration<double>;
+        auto steady_ns = [] {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch());
+        };
+        auto run = [&](size_t repeat, bool paced, std::chrono::nanoseconds period, latency_histogram& queued) {
+            auto input = std::make_unique<tablet_input>();
+            auto& tool = input->add_tool(nullptr);
+            std::atomic<bool> done = false;
+            uint64_t received = 0;
+            size_t largest_drain = 0;
+            auto consume = [&] {
+                auto now = steady_ns();
+                auto n = input->drain([&](tablet_sample const& sample) {
+                    queued.push(now - std::chrono::nanoseconds(sample.received));
+                });
+                received += n;
+                largest_drain = std::max(largest_drain, n);
             };
+            auto t0 = clock::now();
+            std::jthread producer([&] {
+                auto const start = clock::now();
+                for (size_t i = 0; i < repeat; ++i) {
+                    for (auto const& event : stream) {
+                        if (paced && event.kind == tablet_event::frame) {
+                            std::this_thread::sleep_until(start + std::chrono::milliseconds(event.time));
+                        }
+                        input->handle(tool, event);
+                        // unpaced, the producer outruns any consumer; hold it at the ring
+                        // rather than measuring the overload merge
+                        while (!paced && input->backlogged_now() != 0) input->flush();
+                    }
+                }
+                while (input->backlogged_now() != 0) input->flush();
+                done = true;
+            });
+            while (!done) {
+                consume();
+                if (paced) std::this_thread::sleep_for(period);
+            }
+            producer.join();
+            consume();
+            auto elapsed = seconds(clock::now() - t0).count();
+            return std::tuple(received, largest_drain, elapsed, std::move(input));
+        };
+
+        constexpr size_t repeat = 64;
+        latency_histogram burst_latency = { "queue-latency" };
+        auto [burst_samples, burst_drain, burst_elapsed, burst_input] = run(repeat, false, { }, burst_latency);
+        output << "(tablet-benchmark-throughput" << std::endl;
+        output << " (events " << stream.size() * repeat << ")" << std::endl;
+        output << " (samples " << burst_samples << ")" << std::endl;
+        output << " (events-per-sec " << static_cast<double>(stream.size() * repeat) / burst_elapsed << ")" << std::endl;
+        output << " (largest-drain " << burst_drain << ")" << std::endl;
+        output << " " << burst_latency << std::endl;
+        output << " " << *burst_input << ")" << std::endl;
+
+        latency_histogram frame_latency = { "queue-latency" };
+        auto [frame_samples, frame_drain, frame_elapsed, frame_input] =
+            run(1, true, std::chrono::nanoseconds(16'666'667), frame_latency);
+        output << "(tablet-benchmark-60hz" << std::endl;
+        output << " (samples " << frame_samples << ")" << std::endl;
+        output << " (seconds " << frame_elapsed << ")" << std::endl;
+        output << " (largest-drain " << frame_drain << ")" << std::endl;
+        output << " " << frame_latency << std::endl;
+        output << " " << *frame_input << ")" << std::endl;
+    }
 
-            VkDeviceCreateInfo deviceCreateInfo = {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    // What the offscreen benchmarks render with: a one-subpass render pass clearing a single
+    // color attachment that ends in `final_layout`, a view and framebuffer per image, and per frame
+    // in flight a command buffer, a signaled fence and, for a swapchain, the acquire and render
+    // semaphores. Every handle is owned and retires through the installed retire_queue, so a throw
+    // anywhere in a benchmark leaks nothing.
+    struct bench_targets {
+        vk_ptr<VkRenderPass_T> pass;
+        std::vector<vk_ptr<VkImageView_T>> views;
+        std::vector<vk_ptr<VkFramebuffer_T>> framebuffers;
+        vk_ptr<VkCommandPool_T> pool;
+        std::vector<VkCommandBuffer> commands;      // freed with the pool
+        std::vector<vk_ptr<VkFence_T>> fences;
+        std::vector<vk_ptr<VkSemaphore_T>> acquired;
+        std::vector<vk_ptr<VkSemaphore_T>> rendered;
+    };
+    inline bench_targets create_bench_targets(VkDevice device, uint32_t family, VkFormat format, VkExtent2D extent,
+                                              std::vector<VkImage> const& images, VkImageLayout final_layout,
+                                              uint32_t frames_in_flight, bool semaphores)
+    {
+        bench_targets targets;
+        VkAttachmentDescription attachment = {
+            .flags = 0,
+            .format = format,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout = final_layout,
+        };
+        VkAttachmentReference color = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+        VkSubpassDescription subpass = {
+            .flags = 0,
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .inputAttachmentCount = 0,
+            .pInputAttachments = nullptr,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &color,
+            .pResolveAttachments = nullptr,
+            .pDepthStencilAttachment = nullptr,
+            .preserveAttachmentCount = 0,
+            .pPreserveAttachments = nullptr,
+        };
+        VkSubpassDependency dependency = {
+            .srcSubpass = VK_SUBPASS_EXTERNAL,
+            .dstSubpass = 0,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = 0,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dependencyFlags = 0,
+        };
+        VkRenderPassCreateInfo pass_info = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .attachmentCount = 1,
+            .pAttachments = &attachment,
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = 1,
+            .pDependencies = &dependency,
+        };
+        VkRenderPass pass = nullptr;
+        if (VK_SUCCESS != vkCreateRenderPass(device, &pass_info, nullptr, &pass)) {
+            throw std::runtime_error("vkCreateRenderPass failed...");
+        }
+        targets.pass = safe_ptr(pass);
+        for (auto image : images) {
+            VkImageViewCreateInfo view_info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .image = image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = format,
+                .components = { },
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+            };
+            VkImageView view = nullptr;
+            if (VK_SUCCESS != vkCreateImageView(device, &view_info, nullptr, &view)) {
+                throw std::runtime_error("vkCreateImageView failed...");
+            }
+            targets.views.push_back(safe_ptr(view));
+            VkFramebufferCreateInfo framebuffer_info = {
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
                 .pNext = nullptr,
                 .flags = 0,
-                .queueCreateInfoCount = 1,
-                .pQueueCreateInfos = &deviceQueueCreateInfo,
-                .enabledLayerCount = 0,
-                .ppEnabledLayerNames = nullptr,
-                .enabledExtensionCount = std::size(extensions),
-                .ppEnabledExtensionNames = extensions,
-                .pEnabledFeatures = &requiredFeatures,
-            };
-            VkDevice device_raw = nullptr;
-            auto ret = vkCreateDevice(physical_devices(instance.get()).front(),
-                                      &deviceCreateInfo,
-                                      nullptr,
-                                      &device_raw);
-            if (ret != VK_SUCCESS) {
-                std::cerr << "vkCreateDevice failed: " << ret << std::endl;
-            }
-            return device_raw;
-        };
-        auto device = safe_ptr(create_device(),
-                               [](auto ptr) noexcept {
-                                   vkDestroyDevice(ptr, nullptr);
-                               });
-        VkWaylandSurfaceCreateInfoKHR surfaceCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR,
+                .renderPass = pass,
+                .attachmentCount = 1,
+                .pAttachments = &view,
+                .width = extent.width,
+                .height = extent.height,
+                .layers = 1,
+            };
+            VkFramebuffer framebuffer = nullptr;
+            if (VK_SUCCESS != vkCreateFramebuffer(device, &framebuffer_info, nullptr, &framebuffer)) {
+                throw std::runtime_error("vkCreateFramebuffer failed...");
+            }
+            targets.framebuffers.push_back(safe_ptr(framebuffer));
+        }
+
+        VkCommandPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = family,
+        };
+        VkCommandPool pool = nullptr;
+        if (VK_SUCCESS != vkCreateCommandPool(device, &pool_info, nullptr, &pool)) {
+            throw std::runtime_error("vkCreateCommandPool failed...");
+        }
+        targets.pool = safe_ptr(pool);
+        targets.commands.resize(frames_in_flight);
+        VkCommandBufferAllocateInfo command_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .commandPool = pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = frames_in_flight,
+        };
+        if (VK_SUCCESS != vkAllocateCommandBuffers(device, &command_info, targets.commands.data())) {
+            throw std::runtime_error("vkAllocateCommandBuffers failed...");
+        }
+        VkFenceCreateInfo fence_info = {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+        };
+        VkSemaphoreCreateInfo semaphore_info = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
             .pNext = nullptr,
             .flags = 0,
-            .display = display.get(),
-            .surface = surface.get(),
         };
-
-        auto create_surface = [&] {
-            VkSurfaceKHR vk_surface = nullptr;
-            if (VK_SUCCESS != vkCreateWaylandSurfaceKHR(instance.get(), &surfaceCreateInfo, nullptr, &vk_surface)) {
-                std::cerr << "vkCreateWaylandSurfaceKHR failed..." << std::endl;
+        auto create_semaphore = [&] {
+            VkSemaphore semaphore = nullptr;
+            if (VK_SUCCESS != vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore)) {
+                throw std::runtime_error("vkCreateSemaphore failed...");
             }
-            return vk_surface;
+            return safe_ptr(semaphore);
         };
-        auto vk_surface = safe_ptr(create_surface(),
-                                   [&](auto ptr) noexcept {
-                                       vkDestroySurfaceKHR(instance.get(), ptr, nullptr);
-                                   });
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            VkFence fence = nullptr;
+            if (VK_SUCCESS != vkCreateFence(device, &fence_info, nullptr, &fence)) {
+                throw std::runtime_error("vkCreateFence failed...");
+            }
+            targets.fences.push_back(safe_ptr(fence));
+            if (semaphores) {
+                targets.acquired.push_back(create_semaphore());
+                targets.rendered.push_back(create_semaphore());
+            }
+        }
+        return targets;
+    }
 
-        //std::cout << capabilities(physical_devices(instance.get()).front(), vk_surface.get()) << std::endl;
+    // Renders a fixed workload for `frame_count` frames with no compositor: into a
+    // VK_EXT_headless_surface swapchain when `surface` is given, else into offscreen_images.
+    // Same frames-in-flight shape as the windowed loop. Workloads:
+    //   clear: one full-frame animated clear per frame (fill-rate bound)
+    //   rects: the clear plus 1024 single-rect clears (many small commands, record/driver bound)
+    //   batches: the clear plus batch_count batches of batch_rects clears, recorded as one
+    //            secondary per batch on `recorder`'s threads (inline without a recorder)
+    inline constexpr uint32_t batch_count = 2048;
+    inline constexpr uint32_t batch_rects = 4;
+    inline bench_report headless_benchmark(VkPhysicalDevice pdev, VkDevice device, device_allocator& allocator,
+                                           VkQueue queue, uint32_t family, VkSurfaceKHR surface,
+                                           std::string_view workload, uint64_t frame_count, uint32_t frames_in_flight,
+                                           gpu_profiler* profiler = nullptr, parallel_recorder* recorder = nullptr,
+                                           frame_capture* capture = nullptr)
+    {
+        constexpr VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        constexpr uint32_t rect_count = 1024;
+        if (workload != "clear" && workload != "rects" && workload != "batches") {
+            throw std::runtime_error("unknown workload: " + std::string(workload));
+        }
+        bench_report report = {
+            .workload = std::string(workload),
+            .target = surface ? "headless-surface" : "offscreen",
+            .device = properties(pdev).deviceName,
+            .extent = { 1920, 1080 },
+            .frames_in_flight = frames_in_flight,
+            .record_threads = recorder ? static_cast<uint32_t>(recorder->threads()) : 0,
+        };
 
-        auto create_swapchain = [&] {
-            VkSwapchainKHR swapchain = nullptr;
+        vk_ptr<VkSwapchainKHR_T> swapchain;
+        std::optional<offscreen_images> offscreen;
+        std::vector<VkImage> images;
+        if (surface) {
+            auto caps = capabilities(pdev, surface);
+            if (caps.currentExtent.width != UINT32_MAX) report.extent = caps.currentExtent;
+            report.extent.width = std::clamp(report.extent.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+            report.extent.height = std::clamp(report.extent.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+            // nothing scans out, so FIFO would only measure the WSI's fake vblank
+            auto const modes = present_modes(pdev, surface);
+            auto present_mode = VK_PRESENT_MODE_FIFO_KHR;
+            for (auto mode : { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR }) {
+                if (std::find(modes.begin(), modes.end(), mode) != modes.end()) present_mode = mode;
+            }
+            auto image_count = std::max(caps.minImageCount, frames_in_flight);
+            if (caps.maxImageCount != 0) image_count = std::min(image_count, caps.maxImageCount);
+            VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            if (capture && (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            else if (capture) {
+                std::cerr << "swapchain images cannot be transfer sources, capturing nothing" << std::endl;
+                capture = nullptr;
+            }
             VkSwapchainCreateInfoKHR info = {
                 .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
                 .pNext = nullptr,
                 .flags = 0,
-                .surface = vk_surface.get(),
-                .minImageCount = 2,
-                .imageFormat = VK_FORMAT_R8G8B8A8_UNORM,
+                .surface = surface,
+                .minImageCount = image_count,
+                .imageFormat = format,
                 .imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
-                .imageExtent = { 1024, 768 },
+                .imageExtent = report.extent,
                 .imageArrayLayers = 1,
-                .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                .imageUsage = usage,
                 .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
                 .queueFamilyIndexCount = 0,
                 .pQueueFamilyIndices = nullptr,
-                .preTransform = VK_SURFACE_TRANSFORM_INHERIT_BIT_KHR,
+                .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
                 .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-                .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+                .presentMode = present_mode,
                 .clipped = VK_TRUE,
-                .oldSwapchain = swapchain,
+                .oldSwapchain = nullptr,
             };
-            if (auto ret = vkCreateSwapchainKHR(device.get(), &info, nullptr, &swapchain); ret != VK_SUCCESS) {
-                std::cerr << "vkCreateSwapchainKHR failed..." << std::endl;
+            VkSwapchainKHR swapchain_raw = nullptr;
+            if (VK_SUCCESS != vkCreateSwapchainKHR(device, &info, nullptr, &swapchain_raw)) {
+                throw std::runtime_error("vkCreateSwapchainKHR failed...");
             }
-            return swapchain;
+            swapchain = safe_ptr(swapchain_raw);
+            uint32_t count = 0;
+            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device, swapchain.get(), &count, nullptr)) {
+                throw std::runtime_error("vkGetSwapchainImagesKHR failed...");
+            }
+            images.resize(count);
+            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device, swapchain.get(), &count, images.data())) {
+                throw std::runtime_error("vkGetSwapchainImagesKHR failed...");
+            }
+        }
+        else {
+            offscreen.emplace(device, allocator, format, report.extent, frames_in_flight);
+            images = offscreen->get();
+        }
+
+        auto targets = create_bench_targets(device, family, format, report.extent, images,
+                                            swapchain ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                            frames_in_flight, swapchain != nullptr);
+        auto const pass = targets.pass.get();
+
+        // 16x16 rect `i` of the frame, spread over the image and moving with the frame number
+        auto clear_rect = [&](VkCommandBuffer cmd, uint32_t i, uint64_t frame_number) {
+            constexpr uint32_t size = 16;
+            auto const x = static_cast<int32_t>((i * 61 + frame_number * 7) % (report.extent.width - size));
+            auto const y = static_cast<int32_t>((i * 37 + frame_number * 3) % (report.extent.height - size));
+            VkClearAttachment clear = { VK_IMAGE_ASPECT_COLOR_BIT, 0, { .color = {{ 1.0f, float(i % 7) / 6.0f, 0.2f, 1.0f }} } };
+            VkClearRect rect = { { { x, y }, { size, size } }, 0, 1 };
+            vkCmdClearAttachments(cmd, 1, &clear, 1, &rect);
+        };
+        auto record_batch = [&](VkCommandBuffer cmd, uint32_t batch, uint64_t frame_number) {
+            for (uint32_t i = batch * batch_rects; i < (batch + 1) * batch_rects; ++i) clear_rect(cmd, i, frame_number);
         };
-        auto swapchain = safe_ptr(create_swapchain(),
-                                  [&](auto ptr) noexcept {
-                                      vkDestroySwapchainKHR(device.get(), ptr, nullptr);
-                                  });
 
-        auto images = [&]() {
-            uint32_t count = 0;
-            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device.get(), swapchain.get(), &count, nullptr)) {
-                //...
+        auto const start = clock::now();
+        auto previous = start;
+        auto previous_cpu = process_cpu_time();
+        for (uint64_t frame_number = 0; frame_number < frame_count; ++frame_number) {
+            auto const slot = frame_number % frames_in_flight;
+            auto fence = targets.fences[slot].get();
+            auto acquired = swapchain ? targets.acquired[slot].get() : nullptr;
+            auto rendered = swapchain ? targets.rendered[slot].get() : nullptr;
+            {
+                gpu_profiler::cpu_zone zone(profiler, "wait");
+                vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
             }
-            std::vector<VkImage> images(count);
-            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device.get(), swapchain.get(), &count, images.data())) {
-                //...
+            if (recorder) recorder->begin_frame(slot);
+            if (capture) capture->begin_frame(slot);
+            uint32_t idx = 0;
+            if (swapchain) {
+                gpu_profiler::cpu_zone zone(profiler, "acquire");
+                auto ret = vkAcquireNextImageKHR(device, swapchain.get(), UINT64_MAX, acquired, nullptr, &idx);
+                if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR) {
+                    std::cerr << "vkAcquireNextImageKHR failed: " << ret << std::endl;
+                    break;
+                }
             }
-            return images;
-            
-            // auto deleter = [&](auto image) noexcept {
-            //     vkDestroyImage(device.get(), image, nullptr);
-            // };
-            // std::vector<std::unique_ptr<VkImage_T, decltype (deleter)>> result;
-            // for (auto image : images) {
-            //     result.push_back(safe_ptr(image, deleter));
-            // }
-            // return result;
-        }();
-
-        uint32_t idx = 0;
-        while (VK_NOT_READY == vkAcquireNextImageKHR(device.get(),
-                                                     swapchain.get(),
-                                                     0,
-                                                     nullptr,
-                                                     nullptr,
-                                                     &idx))
-            continue;
-
-        std::cout << idx << std::endl;
-
-        // wait to clean up
-        while (vkDeviceWaitIdle(device.get()) != VK_SUCCESS) continue;
+            else {
+                idx = offscreen->acquire();
+            }
+            vkResetFences(device, 1, &fence);
+
+            auto cmd = targets.commands[slot];
+            auto const record_begin = clock::now();
+            VkCommandBufferBeginInfo begin = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = nullptr,
+            };
+            vkBeginCommandBuffer(cmd, &begin);
+            if (profiler) profiler->begin_frame(cmd, slot);
+            std::optional<gpu_profiler::zone> pass_zone(std::in_place, profiler, cmd,
+                                                        workload == "rects" ? "rects" : workload == "batches" ? "batches" : "clear");
+            float const phase = static_cast<float>(frame_number % 256) / 255.0f;
+            VkClearValue background = { .color = {{ phase, 0.25f, 1.0f - phase, 1.0f }} };
+            VkRenderPassBeginInfo pass_begin = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .pNext = nullptr,
+                .renderPass = pass,
+                .framebuffer = targets.framebuffers[idx].get(),
+                .renderArea = { { 0, 0 }, report.extent },
+                .clearValueCount = 1,
+                .pClearValues = &background,
+            };
+            bool const secondaries = recorder && workload == "batches";
+            vkCmdBeginRenderPass(cmd, &pass_begin, secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+            if (secondaries) {
+                VkCommandBufferInheritanceInfo inheritance = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                    .pNext = nullptr,
+                    .renderPass = pass,
+                    .subpass = 0,
+                    .framebuffer = targets.framebuffers[idx].get(),
+                    .occlusionQueryEnable = VK_FALSE,
+                    .queryFlags = 0,
+                    .pipelineStatistics = 0,
+                };
+                auto recorded = recorder->record(inheritance, batch_count, [&](VkCommandBuffer secondary, size_t batch) {
+                    record_batch(secondary, static_cast<uint32_t>(batch), frame_number);
+                });
+                if (!recorded.empty()) vkCmdExecuteCommands(cmd, static_cast<uint32_t>(recorded.size()), recorded.data());
+            }
+            else if (workload == "batches") {
+                for (uint32_t batch = 0; batch < batch_count; ++batch) record_batch(cmd, batch, frame_number);
+            }
+            else if (workload == "rects") {
+                for (uint32_t i = 0; i < rect_count; ++i) clear_rect(cmd, i, frame_number);
+            }
+            vkCmdEndRenderPass(cmd);
+            pass_zone.reset();
+            if (capture && capture->wants(frame_number)) {
+                gpu_profiler::zone zone(profiler, cmd, "capture");
+                capture->record(cmd, slot, frame_number, images[idx],
+                                swapchain ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                format, report.extent);
+            }
+            vkEndCommandBuffer(cmd);
+            report.record_times.push_back(clock::now() - record_begin);
+
+            if (profiler) profiler->submitted(slot);
+            semaphore_wait waits[] = { { acquired, 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } };
+            semaphore_signal signals[] = { { rendered, 0 } };
+            if (VK_SUCCESS != submit(queue,
+                                     std::span(&cmd, 1),
+                                     std::span(waits, swapchain ? 1 : 0),
+                                     std::span(signals, swapchain ? 1 : 0),
+                                     fence))
+            {
+                std::cerr << "vkQueueSubmit failed..." << std::endl;
+                break;
+            }
+            ++report.submits;
+            if (swapchain) {
+                VkSwapchainKHR swapchains[] = { swapchain.get() };
+                VkPresentInfoKHR present = {
+                    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                    .pNext = nullptr,
+                    .waitSemaphoreCount = 1,
+                    .pWaitSemaphores = &rendered,
+                    .swapchainCount = 1,
+                    .pSwapchains = swapchains,
+                    .pImageIndices = &idx,
+                    .pResults = nullptr,
+                };
+                gpu_profiler::cpu_zone zone(profiler, "present");
+                auto ret = vkQueuePresentKHR(queue, &present);
+                if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR) {
+                    std::cerr << "vkQueuePresentKHR failed: " << ret << std::endl;
+                    break;
+                }
+                ++report.presents;
+            }
+            auto const now = clock::now();
+            auto const cpu = process_cpu_time();
+            report.frame_times.push_back(now - previous);
+            report.cpu_times.push_back(cpu - previous_cpu);
+            previous = now;
+            previous_cpu = cpu;
+        }
+        vkDeviceWaitIdle(device);
+        report.elapsed = clock::now() - start;
+        report.finish(allocator);
+        return report;
+    }
+
+    // Recording throughput of the batches workload, offscreen, inline and then on 1, 2, 4, ...
+    // threads up to the hardware concurrency. Only the primary's record span is compared; what the
+    // GPU (lavapipe's rasterizer threads included) does meanwhile overlaps it and is left out.
+    inline void recording_benchmark(VkPhysicalDevice pdev, VkDevice device, device_allocator& allocator,
+                                    VkQueue queue, uint32_t family, uint64_t frame_count, uint32_t frames_in_flight,
+                                    std::ostream& output)
+    {
+        using ms = std::chrono::duration<double, std::milli>;
+        auto median = [](std::vector<std::chrono::nanoseconds> samples) {
+            std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+            return samples.empty() ? std::chrono::nanoseconds() : samples[samples.size() / 2];
+        };
+        auto const hardware = std::max(std::thread::hardware_concurrency(), 1u);
+        std::vector<uint32_t> counts = { 0 };
+        for (uint32_t n = 1; n < hardware; n *= 2) counts.push_back(n);
+        counts.push_back(hardware);
+
+        output << "(recording-benchmark" << std::endl;
+        output << " (batches " << batch_count << ")" << std::endl;
+        output << " (clears-per-batch " << batch_rects << ")" << std::endl;
+        double baseline = 0.0;
+        for (auto threads : counts) {
+            std::optional<parallel_recorder> recorder;
+            if (threads != 0) recorder.emplace(device, family, frames_in_flight, threads);
+            auto report = headless_benchmark(pdev, device, allocator, queue, family, nullptr, "batches",
+                                             frame_count, frames_in_flight, nullptr, recorder ? &*recorder : nullptr);
+            auto const record = ms(median(report.record_times)).count();
+            if (threads == 0) baseline = record;
+            output << " (threads ";
+            if (threads == 0) output << "inline";
+            else output << threads;
+            output << " (record-ms-p50 " << record << ")"
+                   << " (batches-per-sec " << batch_count / std::max(record, 1e-6) * 1e3 << ")"
+                   << " (speedup " << baseline / std::max(record, 1e-6) << ")";
+            if (recorder) output << std::endl << "  " << *recorder;
+            output << ")" << std::endl;
+        }
+        output << ")" << std::endl;
+    }
+
+    // Sustained host-to-device streaming: every frame, 256 scattered 16KiB updates of a 64MiB
+    // device-local buffer plus a full 1024x1024 RGBA8 texture, with `frames_in_flight` frames
+    // queued. The ring path stages into upload_ring; the baseline gives every upload its own
+    // vkAllocateMemory'd staging buffer, mapped and unmapped around the memcpy and freed once the
+    // frame's fence has signaled. Both batch copies the same way and are consumed the same way,
+    // by a graphics submission that waits for the transfer and acquires the destinations.
+    inline void upload_benchmark(VkPhysicalDevice pdev, VkDevice device, device_allocator& allocator,
+                                 device_selection const& selection, uint64_t frame_count, uint32_t frames_in_flight,
+                                 std::ostream& output)
+    {
+        using seconds = std::chrono::duration<double>;
+        constexpr VkDeviceSize buffer_size = VkDeviceSize(64) << 20;
+        constexpr VkDeviceSize chunk = VkDeviceSize(16) << 10;
+        constexpr uint32_t chunks = 256;
+        constexpr VkExtent3D texture_extent = { 1024, 1024, 1 };
+        constexpr VkDeviceSize texture_bytes = VkDeviceSize(texture_extent.width) * texture_extent.height * 4;
+        constexpr VkDeviceSize frame_bytes = chunks * chunk + texture_bytes;
+
+        auto const queues = get_queues(device, selection);
+        VkBufferCreateInfo buffer_info = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .size = buffer_size,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+        };
+        VkBuffer target = nullptr;
+        if (VK_SUCCESS != vkCreateBuffer(device, &buffer_info, nullptr, &target)) {
+            throw std::runtime_error("vkCreateBuffer failed...");
+        }
+        allocation target_memory;
+        // buffers and images do not go through the retire queue; idle first, the copies may still write them
+        auto owned_target = safe_ptr(target, [&](VkBuffer buffer) noexcept {
+            vkDeviceWaitIdle(device);
+            if (target_memory) allocator.free(target_memory);
+            vkDestroyBuffer(device, buffer, nullptr);
+        });
+        target_memory = allocator.bind(target, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VkImageCreateInfo image_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = VK_FORMAT_R8G8B8A8_UNORM,
+            .extent = texture_extent,
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        VkImage texture = nullptr;
+        if (VK_SUCCESS != vkCreateImage(device, &image_info, nullptr, &texture)) {
+            throw std::runtime_error("vkCreateImage failed...");
+        }
+        allocation texture_memory;
+        auto owned_texture = safe_ptr(texture, [&](VkImage image) noexcept {
+            vkDeviceWaitIdle(device);
+            if (texture_memory) allocator.free(texture_memory);
+            vkDestroyImage(device, image, nullptr);
+        });
+        texture_memory = allocator.bind(texture, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // graphics side: one command buffer, fence and transfer semaphore per frame in flight
+        VkCommandPoolCreateInfo pool_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = selection.graphics_family,
+        };
+        VkCommandPool pool = nullptr;
+        if (VK_SUCCESS != vkCreateCommandPool(device, &pool_info, nullptr, &pool)) {
+            throw std::runtime_error("vkCreateCommandPool failed...");
+        }
+        auto owned_pool = safe_ptr(pool);
+        std::vector<VkCommandBuffer> commands(frames_in_flight);
+        VkCommandBufferAllocateInfo command_info = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .commandPool = pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = frames_in_flight,
+        };
+        if (VK_SUCCESS != vkAllocateCommandBuffers(device, &command_info, commands.data())) {
+            throw std::runtime_error("vkAllocateCommandBuffers failed...");
+        }
+        std::vector<vk_ptr<VkFence_T>> fences;
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            VkFenceCreateInfo fence_info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+            VkFence fence = nullptr;
+            if (VK_SUCCESS != vkCreateFence(device, &fence_info, nullptr, &fence)) {
+                throw std::runtime_error("vkCreateFence failed...");
+            }
+            fences.push_back(safe_ptr(fence));
+        }
+
+        std::vector<uint32_t> source(frame_bytes / 4);
+        std::iota(source.begin(), source.end(), 0u);
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<VkDeviceSize> slot(0, buffer_size / chunk - 1);
+
+        // runs the frames; `stage_frame` stages one frame's bytes and returns the semaphore to wait on
+        auto run = [&](auto&& begin_frame, auto&& stage_frame, auto&& acquire) {
+            auto const start = clock::now();
+            for (uint64_t frame_number = 0; frame_number < frame_count; ++frame_number) {
+                auto const index = frame_number % frames_in_flight;
+                VkFence const fence = fences[index].get();
+                vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+                vkResetFences(device, 1, &fence);
+                begin_frame(index);
+                auto ready = stage_frame();
+                auto cmd = commands[index];
+                VkCommandBufferBeginInfo begin = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                    .pInheritanceInfo = nullptr,
+                };
+                vkBeginCommandBuffer(cmd, &begin);
+                acquire(cmd);
+                vkEndCommandBuffer(cmd);
+                semaphore_wait waits[] = { { ready, 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT } };
+                if (VK_SUCCESS != submit(queues.graphics, std::span(&cmd, 1), std::span(waits, ready ? 1 : 0), { }, fence)) {
+                    throw std::runtime_error("vkQueueSubmit failed...");
+                }
+            }
+            vkDeviceWaitIdle(device);
+            return seconds(clock::now() - start).count();
+        };
+
+        // the ring
+        double ring_seconds = 0.0;
+        {
+            upload_ring ring(pdev, device, allocator, queues.transfer, selection.transfer_family, selection.graphics_family,
+                             frames_in_flight, align_up(frame_bytes + (VkDeviceSize(1) << 20), VkDeviceSize(1) << 20));
+            ring_seconds = run(
+                [&](size_t index) { ring.begin_frame(index); },
+                [&] {
+                    auto const* bytes = reinterpret_cast<char const*>(source.data());
+                    for (uint32_t i = 0; i < chunks; ++i) ring.upload(target, slot(rng) * chunk, bytes + i * chunk, chunk);
+                    if (auto ptr = ring.stage(texture, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, texture_extent,
+                                              texture_bytes, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
+                    {
+                        std::memcpy(ptr, bytes + chunks * chunk, texture_bytes);
+                    }
+                    return ring.submit();
+                },
+                [&](VkCommandBuffer cmd) {
+                    ring.acquire(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+                });
+            output << "(upload-benchmark" << std::endl;
+            output << " " << ring << std::endl;
+        }
+
+        // the baseline: a staging allocation, map and unmap per upload
+        struct staging {
+            VkBuffer buffer = nullptr;
+            VkDeviceMemory memory = nullptr;
+        };
+        std::vector<std::vector<staging>> in_flight(frames_in_flight);
+        auto free_staging = [&](size_t index) noexcept {
+            for (auto [buffer, memory] : in_flight[index]) {
+                vkDestroyBuffer(device, buffer, nullptr);
+                vkFreeMemory(device, memory, nullptr);
+            }
+            in_flight[index].clear();
+        };
+        auto owned_staging = safe_ptr(&in_flight, [&](auto) noexcept {
+            vkDeviceWaitIdle(device);
+            for (size_t i = 0; i < in_flight.size(); ++i) free_staging(i);
+        });
+        std::vector<VkCommandBuffer> transfer_commands(frames_in_flight);
+        VkCommandPool transfer_pool = nullptr;
+        pool_info.queueFamilyIndex = selection.transfer_family;
+        if (VK_SUCCESS != vkCreateCommandPool(device, &pool_info, nullptr, &transfer_pool)) {
+            throw std::runtime_error("vkCreateCommandPool failed...");
+        }
+        auto owned_transfer_pool = safe_ptr(transfer_pool);
+        command_info.commandPool = transfer_pool;
+        if (VK_SUCCESS != vkAllocateCommandBuffers(device, &command_info, transfer_commands.data())) {
+            throw std::runtime_error("vkAllocateCommandBuffers failed...");
+        }
+        std::vector<vk_ptr<VkSemaphore_T>> transferred;
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            VkSemaphoreCreateInfo semaphore_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+            };
+            VkSemaphore semaphore = nullptr;
+            if (VK_SUCCESS != vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore)) {
+                throw std::runtime_error("vkCreateSemaphore failed...");
+            }
+            transferred.push_back(safe_ptr(semaphore));
+        }
+        auto const cross_family = selection.transfer_family != selection.graphics_family;
+        size_t current = 0;
+        auto stage = [&](void const* data, VkDeviceSize size) {
+            buffer_info.size = size;
+            buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            // listed before anything is created, so a failure below is freed with the frame
+            auto& entry = in_flight[current].emplace_back();
+            VkBuffer buffer = nullptr;
+            if (VK_SUCCESS != vkCreateBuffer(device, &buffer_info, nullptr, &buffer)) {
+                throw std::runtime_error("vkCreateBuffer failed...");
+            }
+            entry.buffer = buffer;
+            VkMemoryRequirements requirements;
+            vkGetBufferMemoryRequirements(device, buffer, &requirements);
+            VkMemoryAllocateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .allocationSize = requirements.size,
+                .memoryTypeIndex = allocator.find_memory_type(requirements.memoryTypeBits,
+                                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+            };
+            VkDeviceMemory memory = nullptr;
+            if (VK_SUCCESS != vkAllocateMemory(device, &info, nullptr, &memory)) {
+                throw std::runtime_error("vkAllocateMemory failed...");
+            }
+            entry.memory = memory;
+            if (VK_SUCCESS != vkBindBufferMemory(device, buffer, memory, 0)) {
+                throw std::runtime_error("vkBindBufferMemory failed...");
+            }
+            void* ptr = nullptr;
+            if (VK_SUCCESS != vkMapMemory(device, memory, 0, size, 0, &ptr)) {
+                throw std::runtime_error("vkMapMemory failed...");
+            }
+            std::memcpy(ptr, data, size);
+            vkUnmapMemory(device, memory);
+            return buffer;
+        };
+        auto release_barriers = [&](VkAccessFlags dst_access, bool acquire) {
+            VkBufferMemoryBarrier buffer_barrier = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = acquire ? 0u : VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = acquire ? dst_access : 0u,
+                .srcQueueFamilyIndex = selection.transfer_family,
+                .dstQueueFamilyIndex = selection.graphics_family,
+                .buffer = target,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE,
+            };
+            VkImageMemoryBarrier image_barrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = acquire ? 0u : VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = acquire ? VK_ACCESS_SHADER_READ_BIT : 0u,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                .srcQueueFamilyIndex = cross_family ? selection.transfer_family : VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = cross_family ? selection.graphics_family : VK_QUEUE_FAMILY_IGNORED,
+                .image = texture,
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+            };
+            return std::pair(buffer_barrier, image_barrier);
+        };
+        auto const baseline_seconds = run(
+            [&](size_t index) { free_staging(current = index); },
+            [&] {
+                auto const* bytes = reinterpret_cast<char const*>(source.data());
+                auto cmd = transfer_commands[current];
+                VkCommandBufferBeginInfo begin = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                    .pInheritanceInfo = nullptr,
+                };
+                vkBeginCommandBuffer(cmd, &begin);
+                for (uint32_t i = 0; i < chunks; ++i) {
+                    VkBufferCopy region = { 0, slot(rng) * chunk, chunk };
+                    vkCmdCopyBuffer(cmd, stage(bytes + i * chunk, chunk), target, 1, &region);
+                }
+                VkImageMemoryBarrier to_transfer = release_barriers(0, false).second;
+                to_transfer.srcAccessMask = 0;
+                to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                to_transfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                to_transfer.srcQueueFamilyIndex = to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                     0, nullptr, 0, nullptr, 1, &to_transfer);
+                VkBufferImageCopy copy = { 0, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, texture_extent };
+                vkCmdCopyBufferToImage(cmd, stage(bytes + chunks * chunk, texture_bytes), texture,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+                auto [buffer_release, image_release] = release_barriers(0, false);
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                     0, nullptr, cross_family ? 1 : 0, &buffer_release, 1, &image_release);
+                vkEndCommandBuffer(cmd);
+                semaphore_signal signals[] = { { transferred[current].get(), 0 } };
+                if (VK_SUCCESS != submit(queues.transfer, std::span(&cmd, 1), { }, signals)) {
+                    throw std::runtime_error("vkQueueSubmit failed...");
+                }
+                return transferred[current].get();
+            },
+            [&](VkCommandBuffer cmd) {
+                if (!cross_family) return;
+                auto [buffer_acquire, image_acquire] = release_barriers(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, true);
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                                     0, nullptr, 1, &buffer_acquire, 1, &image_acquire);
+            });
+
+        auto const total = static_cast<double>(frame_bytes * frame_count);
+        auto const gib = double(VkDeviceSize(1) << 30);
+        output << " (frames " << frame_count << ")" << std::endl;
+        output << " (bytes-per-frame " << frame_bytes << ")" << std::endl;
+        output << " (ring-gib-per-sec " << total / gib / ring_seconds << ")" << std::endl;
+        output << " (per-upload-staging-gib-per-sec " << total / gib / baseline_seconds << ")" << std::endl;
+        output << " (speedup " << baseline_seconds / ring_seconds << "))" << std::endl;
+    }
+
+    // `object_count` instanced objects under an orbiting camera, offscreen, once per draw path the
+    // device supports: a CPU cull and one vkCmdDrawIndexed per visible object, a CPU cull into one
+    // multi-draw indirect call, and cull.comp feeding a single indirect (count) draw. The record
+    // span includes the CPU cull, which is exactly the cost the gpu path moves off the CPU.
+    inline void indirect_benchmark(VkPhysicalDevice pdev, VkDevice device, device_allocator& allocator,
+                                   device_selection const& selection, uint32_t object_count,
+                                   uint64_t frame_count, uint32_t frames_in_flight, std::ostream& output)
+    {
+        using ms = std::chrono::duration<double, std::milli>;
+        constexpr VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+        constexpr VkExtent2D extent = { 1920, 1080 };
+        auto median = [](std::vector<std::chrono::nanoseconds> samples) {
+            std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+            return samples.empty() ? std::chrono::nanoseconds() : samples[samples.size() / 2];
+        };
+        auto const queues = get_queues(device, selection);
+
+        offscreen_images target(device, allocator, format, extent, frames_in_flight);
+        auto targets = create_bench_targets(device, selection.graphics_family, format, extent, target.get(),
+                                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frames_in_flight, false);
+        auto const pass = targets.pass.get();
+
+        // a 400-unit cube of spheres; the camera orbits it from outside, so about a third is in view
+        std::vector<object> objects(object_count);
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> position(-200.0f, 200.0f), radius(0.5f, 2.0f), shade(0.2f, 1.0f);
+        for (uint32_t i = 0; i < object_count; ++i) {
+            objects[i] = {
+                .sphere = { position(rng), position(rng), position(rng), radius(rng) },
+                .color = { shade(rng), shade(rng), shade(rng), 1.0f },
+                .mesh = i % 2,
+                .pad = { },
+            };
+        }
+        {
+            pipeline_cache pipelines(pdev, device, std::chrono::seconds(0));
+            upload_ring ring(pdev, device, allocator, queues.transfer, selection.transfer_family, selection.graphics_family, 1);
+            ring.begin_frame(0);
+            indirect_scene scene(pdev, device, allocator, pipelines, ring, pass, frames_in_flight, objects);
+            auto uploaded = ring.submit();
+            auto const projection = perspective(1.0472f, float(extent.width) / float(extent.height), 0.1f, 1000.0f);
+
+            output << "(indirect-benchmark" << std::endl;
+            output << " " << scene << std::endl;
+            output << " (frames " << frame_count << ")" << std::endl;
+            for (auto path : { draw_path::direct, draw_path::cpu_indirect, draw_path::gpu }) {
+                if (!scene.supports(path)) {
+                    output << " (path " << path << " unsupported)" << std::endl;
+                    continue;
+                }
+                scene.use(path);
+                std::vector<std::chrono::nanoseconds> record_times, frame_times;
+                auto previous = clock::now();
+                for (uint64_t frame_number = 0; frame_number < frame_count; ++frame_number) {
+                    auto const slot = frame_number % frames_in_flight;
+                    auto fence = targets.fences[slot].get();
+                    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+                    vkResetFences(device, 1, &fence);
+                    auto const t = 0.01f * frame_number;
+                    auto const view_proj = projection * look_at({ 320.0f * std::cos(t), 60.0f, 320.0f * std::sin(t) },
+                                                                { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f });
+
+                    auto const record_begin = clock::now();
+                    auto cmd = targets.commands[slot];
+                    VkCommandBufferBeginInfo begin = {
+                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                        .pNext = nullptr,
+                        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                        .pInheritanceInfo = nullptr,
+                    };
+                    vkBeginCommandBuffer(cmd, &begin);
+                    if (uploaded) {
+                        ring.acquire(cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT, 0);
+                    }
+                    scene.cull(cmd, slot, extract_frustum(view_proj));
+                    VkClearValue clear = { .color = { .float32 = { 0.0f, 0.0f, 0.0f, 1.0f } } };
+                    VkRenderPassBeginInfo pass_begin = {
+                        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                        .pNext = nullptr,
+                        .renderPass = pass,
+                        .framebuffer = targets.framebuffers[target.acquire()].get(),
+                        .renderArea = { { 0, 0 }, extent },
+                        .clearValueCount = 1,
+                        .pClearValues = &clear,
+                    };
+                    vkCmdBeginRenderPass(cmd, &pass_begin, VK_SUBPASS_CONTENTS_INLINE);
+                    scene.draw(cmd, slot, view_proj, extent);
+                    vkCmdEndRenderPass(cmd);
+                    vkEndCommandBuffer(cmd);
+                    record_times.push_back(clock::now() - record_begin);
+
+                    semaphore_wait waits[] = { { uploaded, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT } };
+                    if (VK_SUCCESS != submit(queues.graphics, std::span(&cmd, 1), std::span(waits, uploaded ? 1 : 0), { }, fence)) {
+                        throw std::runtime_error("vkQueueSubmit failed...");
+                    }
+                    uploaded = nullptr;
+                    auto const now = clock::now();
+                    frame_times.push_back(now - previous);
+                    previous = now;
+                }
+                vkDeviceWaitIdle(device);
+                output << " (path " << path
+                       << " (record-ms-p50 " << ms(median(record_times)).count() << ")"
+                       << " (frame-ms-p50 " << ms(median(frame_times)).count() << ")"
+                       << " (draw-calls " << scene.last_draw_calls() << ")";
+                if (path != draw_path::gpu) output << " (visible " << scene.last_visible() << ")";
+                output << ")" << std::endl;
+            }
+            output << ")" << std::endl;
+        }
+    }
+} // ::bench
+
+struct options {
+    uint32_t frames_in_flight = 2;
+    uint64_t frame_count = 0;   // 0: run until interrupted
+    uint32_t resize_storm = 0;  // >0: fake a configure with a new size every N frames
+    bool low_latency = false;   // prefer MAILBOX, then IMMEDIATE, over FIFO
+    bool bench_allocator = false;
+    std::optional<std::string> bench_tablet;   // "": synthetic 500Hz stroke, else a recorded stream
+    std::string record_tablet;                  // write raw pen events here, for --bench-tablet=
+    bool sycl = false;                          // frames come from a SYCL kernel instead of a clear
+    bool sycl_staging = false;                  // ... through the staging copy even if zero-copy works
+    bool bench_sycl = false;
+    bool backend_shm = false;                   // present through wl_shm even if vulkan works
+    bool scalar_raster = false;                 // software backend without SIMD kernels
+    bool bench_raster = false;
+    bool cursor_scene = false;                  // static background with a moving cursor-sized rect
+    bool damage = true;                         // repaint and present only what changed
+    bool headless = false;                      // no compositor: headless surface or offscreen images
+    std::string workload = "clear";             // headless workload, see headless_benchmark
+    std::string json;                           // headless report goes here ("": stdout)
+    std::string trace;                          // chrome trace of cpu and gpu zones, if set
+    bool validation = false;                    // VK_LAYER_KHRONOS_validation, if installed
+    bool api_dump = false;                      // VK_LAYER_LUNARG_api_dump, if installed
+    bool dump_caps = false;                     // print every physical device's properties and layers
+    uint32_t record_threads = 0;                // headless batches workload: 0 records inline
+    bool bench_recording = false;
+    bool bench_upload = false;
+    bool bench_indirect = false;
+    uint32_t object_count = 100000;             // --bench-indirect scene size
+    uint32_t window_count = 1;                  // toplevels sharing one device, each with its own swapchain
+    std::string capture;                        // frame readback for golden tests goes here, if set
+    std::string capture_format = "raw";         // raw, png or hash, see frame_capture
+    uint32_t capture_every = 1;                 // capture frames whose number is a multiple of this
+    bool capture_drop = false;                  // drop frames the capture writer is late for instead of waiting
+};
+inline auto parse_options(int argc, char** argv) {
+    options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        auto number = [&](std::string_view key, auto& value) {
+            if (!arg.starts_with(key)) return false;
+            auto str = arg.substr(key.size());
+            if (std::from_chars(str.data(), str.data() + str.size(), value).ec != std::errc{}) {
+                throw std::runtime_error("bad option: " + std::string(arg));
+            }
+            return true;
+        };
+        if (number("--frames-in-flight=", opts.frames_in_flight)) continue;
+        if (number("--frames=", opts.frame_count)) continue;
+        if (number("--resize-storm=", opts.resize_storm)) continue;
+        if (arg == "--low-latency") { opts.low_latency = true; continue; }
+        if (arg == "--bench-allocator") { opts.bench_allocator = true; continue; }
+        if (arg == "--bench-tablet") { opts.bench_tablet = ""; continue; }
+        if (arg.starts_with("--bench-tablet=")) { opts.bench_tablet = arg.substr(15); continue; }
+        if (arg.starts_with("--record-tablet=")) { opts.record_tablet = arg.substr(16); continue; }
+        if (arg == "--sycl") { opts.sycl = true; continue; }
+        if (arg == "--sycl=staging") { opts.sycl = opts.sycl_staging = true; continue; }
+        if (arg == "--bench-sycl") { opts.bench_sycl = true; continue; }
+        if (arg == "--backend=shm") { opts.backend_shm = true; continue; }
+        if (arg == "--backend=vulkan") { opts.backend_shm = false; continue; }
+        if (arg == "--raster=scalar") { opts.scalar_raster = true; continue; }
+        if (arg == "--bench-raster") { opts.bench_raster = true; continue; }
+        if (arg == "--scene=cursor") { opts.cursor_scene = true; continue; }
+        if (arg == "--damage=off") { opts.damage = false; continue; }
+        if (arg == "--headless") { opts.headless = true; continue; }
+        if (arg.starts_with("--workload=")) { opts.workload = arg.substr(11); continue; }
+        if (arg.starts_with("--json=")) { opts.json = arg.substr(7); continue; }
+        if (arg.starts_with("--trace=")) { opts.trace = arg.substr(8); continue; }
+        if (arg == "--validation") { opts.validation = true; continue; }
+        if (arg == "--api-dump") { opts.api_dump = true; continue; }
+        if (arg == "--dump-caps") { opts.dump_caps = true; continue; }
+        if (number("--record-threads=", opts.record_threads)) continue;
+        if (arg == "--bench-recording") { opts.bench_recording = true; continue; }
+        if (arg == "--bench-upload") { opts.bench_upload = true; continue; }
+        if (arg == "--bench-indirect") { opts.bench_indirect = true; continue; }
+        if (number("--objects=", opts.object_count)) continue;
+        if (number("--windows=", opts.window_count)) continue;
+        if (arg.starts_with("--capture=")) { opts.capture = arg.substr(10); continue; }
+        if (arg.starts_with("--capture-format=")) { opts.capture_format = arg.substr(17); continue; }
+        if (number("--capture-every=", opts.capture_every)) continue;
+        if (arg == "--capture-drop") { opts.capture_drop = true; continue; }
+        throw std::runtime_error("unknown option: " + std::string(arg));
+    }
+    opts.frames_in_flight = std::clamp<uint32_t>(opts.frames_in_flight, 1, 8);
+    opts.window_count = std::clamp<uint32_t>(opts.window_count, 1, 16);
+    opts.capture_every = std::max<uint32_t>(opts.capture_every, 1);
+    parse_capture_format(opts.capture_format);
+    return opts;
+}
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+int main(int argc, char** argv) {
+    // std::cout << "instance layers:" << std::endl;
+    // for (auto const& layer : layers()) {
+    //     std::cout << layer << std::endl;
+    //     for (auto const& extension : extensions(layer.layerName)) {
+    //         std::cout << '\t' << extension << std::endl;
+    //     }
+    // }
+    // std::cout << "instance extensions:" << std::endl;
+    // auto instance_extensions = extensions();
+    // for (auto const& extension : extensions()) {
+    //     std::cout << extension << std::endl;
+    // }
+
+    phase_timer startup;
+    try {
+        auto opts = parse_options(argc, argv);
+        std::signal(SIGINT, [](int) { interrupted = 1; });
+        if (opts.bench_raster) {
+            raster_benchmark(std::cout);
+            return 0;
+        }
+        if (opts.bench_tablet) {
+            auto stream = synthesize_stroke(2500, 500);
+            if (!opts.bench_tablet->empty()) {
+                std::ifstream input(*opts.bench_tablet);
+                if (!input) throw std::runtime_error("cannot open " + *opts.bench_tablet);
+                stream.clear();
+                for (tablet_event event; input >> event; ) stream.push_back(event);
+            }
+            tablet_benchmark(stream, std::cout);
+            return 0;
+        }
+        if (opts.headless || opts.bench_recording || opts.bench_upload || opts.bench_indirect) {
+            // No wayland connection and no debug layers; whatever ICD the loader picks (lavapipe in
+            // CI through VK_DRIVER_FILES) renders into a headless surface or offscreen images.
+            bool const headless_surface = has_extension(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+            std::vector<char const*> instance_extensions;
+            if (headless_surface) {
+                instance_extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+            }
+            auto instance = safe_ptr(create_instance({ }, instance_extensions), destroy_instance);
+            auto selection = select_device(instance.get(), [](VkPhysicalDevice, uint32_t) { return true; });
+            if (selection.physical_device == nullptr) throw std::runtime_error("no vulkan device...");
+            std::vector<char const*> device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+            if (has_extension(selection.physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+                device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            }
+            auto device = safe_ptr(create_device(selection, device_extensions), destroy_device);
+            // what the benchmarks create retires here; destroying it drains before the device goes
+            retire_queue retired(device.get());
+            if (opts.bench_recording) {
+                device_allocator allocator(selection.physical_device, device.get());
+                recording_benchmark(selection.physical_device, device.get(), allocator,
+                                    get_queues(device.get(), selection).graphics, selection.graphics_family,
+                                    opts.frame_count ? opts.frame_count : 240, opts.frames_in_flight, std::cout);
+                return 0;
+            }
+            if (opts.bench_upload) {
+                device_allocator allocator(selection.physical_device, device.get());
+                upload_benchmark(selection.physical_device, device.get(), allocator, selection,
+                                 opts.frame_count ? opts.frame_count : 240, opts.frames_in_flight, std::cout);
+                return 0;
+            }
+            if (opts.bench_indirect) {
+                device_allocator allocator(selection.physical_device, device.get());
+                indirect_benchmark(selection.physical_device, device.get(), allocator, selection, opts.object_count,
+                                   opts.frame_count ? opts.frame_count : 240, opts.frames_in_flight, std::cout);
+                return 0;
+            }
+            auto report = [&] {
+                device_allocator allocator(selection.physical_device, device.get());
+                std::optional<gpu_profiler> profiler;
+                if (!opts.trace.empty()) {
+                    profiler.emplace(selection.physical_device, device.get(), selection.graphics_family, opts.frames_in_flight);
+                }
+                std::optional<parallel_recorder> recorder;
+                if (opts.record_threads != 0) {
+                    recorder.emplace(device.get(), selection.graphics_family, opts.frames_in_flight, opts.record_threads);
+                }
+                std::optional<frame_capture> capture;
+                if (!opts.capture.empty()) {
+                    // three spare buffers ride out a writer that is a few frames late
+                    capture.emplace(device.get(), allocator, opts.capture, parse_capture_format(opts.capture_format),
+                                    opts.capture_every, opts.frames_in_flight, opts.frames_in_flight + 3, opts.capture_drop);
+                }
+                // the swapchain made on it is retired, so it is drained before the surface goes
+                auto destroy_surface = [&](VkSurfaceKHR surface) noexcept {
+                    retired.drain();
+                    vkDestroySurfaceKHR(instance.get(), surface, nullptr);
+                };
+                std::unique_ptr<VkSurfaceKHR_T, decltype (destroy_surface)> surface(
+                    headless_surface ? create_headless_surface(instance.get()) : nullptr, destroy_surface);
+                auto report = headless_benchmark(selection.physical_device, device.get(), allocator,
+                                                 get_queues(device.get(), selection).graphics, selection.graphics_family,
+                                                 surface.get(), opts.workload,
+                                                 opts.frame_count ? opts.frame_count : 600, opts.frames_in_flight,
+                                                 profiler ? &*profiler : nullptr, recorder ? &*recorder : nullptr,
+                                                 capture ? &*capture : nullptr);
+                surface.reset();
+                if (capture) {
+                    capture->finish();
+                    std::cerr << *capture << std::endl;
+                }
+                if (profiler) {
+                    profiler->flush();
+                    std::ofstream trace(opts.trace);
+                    profiler->write_trace(trace);
+                    std::cerr << *profiler << std::endl;
+                }
+                if (recorder) std::cerr << *recorder << std::endl;
+                return report;
+            }();
+            if (opts.json.empty()) {
+                write_json(std::cout, report);
+            }
+            else {
+                std::ofstream output(opts.json);
+                if (!output) throw std::runtime_error("cannot open " + opts.json);
+                write_json(output, report);
+            }
+            return 0;
+        }
+
+        auto display = startup.run("wayland-connect", [] { return safe_ptr(wl_display_connect(nullptr)); });
+
+        // All Vulkan needs from Wayland is the wl_display, for the presentation support query, so
+        // instance and device creation run on a worker while this thread does the registry
+        // roundtrip and waits for the first configure. Pipeline warm-up follows on the same
+        // worker and is only joined after the first present.
+        auto bring_up_vulkan = [&](wl_display* display) {
+            vulkan_context context;
+            std::vector<char const*> instance_layers;
+            std::vector<char const*> instance_extensions = {
+                VK_KHR_SURFACE_EXTENSION_NAME,
+                VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME,
+            };
+            if (opts.validation || opts.api_dump) {
+                auto const available = vulkan::layers();
+                auto request = [&](char const* name) {
+                    if (std::any_of(available.begin(), available.end(), [&](auto const& l) { return std::string_view(name) == l.layerName; })) {
+                        instance_layers.push_back(name);
+                    }
+                    else {
+                        std::cerr << name << " is not installed, running without it" << std::endl;
+                    }
+                };
+                if (opts.validation) request("VK_LAYER_KHRONOS_validation");
+                if (opts.api_dump) request("VK_LAYER_LUNARG_api_dump");
+            }
+            // the validation layer provides debug_utils itself when the loader does not
+            bool debug_utils = false;
+            if (opts.validation && !instance_layers.empty() && std::string_view(instance_layers.front()) == "VK_LAYER_KHRONOS_validation") {
+                auto const provided = extensions("VK_LAYER_KHRONOS_validation");
+                debug_utils = has_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME) ||
+                    std::any_of(provided.begin(), provided.end(), [](auto const& e) { return std::string_view(VK_EXT_DEBUG_UTILS_EXTENSION_NAME) == e.extensionName; });
+                if (debug_utils) instance_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+                else std::cerr << "no " VK_EXT_DEBUG_UTILS_EXTENSION_NAME ", validation messages are not counted" << std::endl;
+            }
+            auto instance_raw = startup.run("vulkan-instance", [&] { return create_instance(instance_layers, instance_extensions); });
+            if (instance_raw == nullptr) return context;
+            context.instance = safe_ptr(instance_raw, destroy_instance);
+            if (debug_utils) context.messages = std::make_unique<debug_messenger>(instance_raw);
+            if (opts.dump_caps) {
+                for (auto pdev : physical_devices(instance_raw)) {
+                    std::cout << properties(pdev) << std::endl;
+                    for (auto const& layer : vulkan::layers(pdev)) {
+                        std::cout << layer << std::endl;
+                    }
+                }
+            }
+            context.selection = startup.run("device-select", [&] { return select_device(instance_raw, display); });
+            auto const physical_device = context.selection.physical_device;
+            if (physical_device == nullptr) return context;
+
+            context.external_memory_host = has_extension(physical_device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            context.incremental_present = opts.damage && has_extension(physical_device, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+            std::vector<char const*> device_extensions = {
+                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+            };
+            if (context.external_memory_host) {
+                device_extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+            }
+            if (context.incremental_present) {
+                device_extensions.push_back(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+            }
+            auto device_raw = startup.run("device-create", [&] { return create_device(context.selection, device_extensions); });
+            if (device_raw != nullptr) {
+                context.device = safe_ptr(device_raw, destroy_device);
+                context.retired = std::make_unique<retire_queue>(device_raw);
+            }
+            return context;
+        };
+        auto create_fill_pipeline = [](VkDevice device, pipeline_cache& pipelines) {
+            VkDescriptorSetLayoutBinding binding = {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = nullptr,
+            };
+            VkDescriptorSetLayoutCreateInfo set_layout_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .bindingCount = 1,
+                .pBindings = &binding,
+            };
+            VkDescriptorSetLayout set_layout = nullptr;
+            if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &set_layout)) {
+                throw std::runtime_error("vkCreateDescriptorSetLayout failed...");
+            }
+            auto owned_set_layout = safe_ptr(set_layout);
+            VkPushConstantRange push_constants = {
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .offset = 0,
+                .size = 3 * sizeof (uint32_t),
+            };
+            VkPipelineLayoutCreateInfo layout_info = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .setLayoutCount = 1,
+                .pSetLayouts = &set_layout,
+                .pushConstantRangeCount = 1,
+                .pPushConstantRanges = &push_constants,
+            };
+            VkPipelineLayout layout = nullptr;
+            if (VK_SUCCESS != vkCreatePipelineLayout(device, &layout_info, nullptr, &layout)) {
+                throw std::runtime_error("vkCreatePipelineLayout failed...");
+            }
+            auto owned_layout = safe_ptr(layout);
+            VkShaderModuleCreateInfo module_info = {
+                .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .codeSize = sizeof (fill_comp_spv),
+                .pCode = fill_comp_spv,
+            };
+            VkShaderModule module = nullptr;
+            if (VK_SUCCESS != vkCreateShaderModule(device, &module_info, nullptr, &module)) {
+                throw std::runtime_error("vkCreateShaderModule failed...");
+            }
+            // only needed while the pipeline is created
+            auto owned_module = safe_ptr(module, [device](VkShaderModule module) noexcept {
+                vkDestroyShaderModule(device, module, nullptr);
+            });
+            auto pipeline = pipelines.create({
+                    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = 0,
+                    .stage = {
+                        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                        .pNext = nullptr,
+                        .flags = 0,
+                        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                        .module = module,
+                        .pName = "main",
+                        .pSpecializationInfo = nullptr,
+                    },
+                    .layout = layout,
+                    .basePipelineHandle = nullptr,
+                    .basePipelineIndex = -1,
+                });
+            return std::tuple {
+                std::move(owned_set_layout),
+                std::move(owned_layout),
+                safe_ptr(pipeline),
+            };
+        };
+        auto warm_up_pipelines = [&](VkPhysicalDevice physical_device, VkDevice device) {
+            auto pipelines = std::make_unique<pipeline_cache>(physical_device, device);
+            auto fill = create_fill_pipeline(device, *pipelines);
+            return std::optional(std::pair(std::move(pipelines), std::move(fill)));
+        };
+        // `vk` outlives the worker: `warmup` is declared after it, so it is joined first.
+        std::optional<vulkan_context> vk;
+        std::promise<vulkan_context> vulkan_promise;
+        auto vulkan_ready = vulkan_promise.get_future();
+        std::future<decltype (warm_up_pipelines(nullptr, nullptr))> warmup;
+        if (!opts.backend_shm) {
+            warmup = std::async(std::launch::async, [&, display = display.get()]() -> decltype (warm_up_pipelines(nullptr, nullptr)) {
+                VkPhysicalDevice physical_device = nullptr;
+                VkDevice device = nullptr;
+                try {
+                    auto context = bring_up_vulkan(display);
+                    physical_device = context.selection.physical_device;
+                    device = context.device.get();
+                    vulkan_promise.set_value(std::move(context));
+                }
+                catch (...) {
+                    vulkan_promise.set_exception(std::current_exception());
+                    return std::nullopt;
+                }
+                if (device == nullptr) return std::nullopt;
+                return startup.run("pipeline-warmup", [&] { return warm_up_pipelines(physical_device, device); });
+            });
+        }
+        // Everything but the registry moves to private queues, which only the event thread
+        // dispatches once the window is up: input (seat, tablet), the surface role (shell ping,
+        // xdg configure/close) and per-frame feedback (wp_presentation).
+        auto input_queue = safe_ptr(wl_display_create_queue(display.get()));
+        auto surface_queue = safe_ptr(wl_display_create_queue(display.get()));
+        auto frame_queue = safe_ptr(wl_display_create_queue(display.get()));
+        // wl_output stays on the default queue; its scale and mode are read by the render thread
+        output_registry outputs;
+        auto registry = safe_ptr(wl_display_get_registry(display.get()));
+
+        static wl_compositor* compositor_raw = nullptr;
+        static zxdg_shell_v6* shell_raw = nullptr;
+        static wp_presentation* presentation_raw = nullptr;
+        static wl_shm* shm_raw = nullptr;
+        static wl_seat* seat_raw = nullptr;
+        static zwp_tablet_manager_v2* tablet_manager_raw = nullptr;
+        wl_registry_listener listener = {
+            .global = [](auto data, auto registry, auto name, auto interface, auto version) noexcept {
+                if (std::string_view(interface) == wl_compositor_interface.name) {
+                    compositor_raw = (wl_compositor*) wl_registry_bind(registry,
+                                                                       name,
+                                                                       &wl_compositor_interface,
+                                                                       version);
+                }
+                else if (std::string_view(interface) == zxdg_shell_v6_interface.name) {
+                    shell_raw = (zxdg_shell_v6*) wl_registry_bind(registry,
+                                                                  name,
+                                                                  &zxdg_shell_v6_interface,
+                                                                  version);
+                }
+                else if (std::string_view(interface) == wp_presentation_interface.name) {
+                    presentation_raw = (wp_presentation*) wl_registry_bind(registry,
+                                                                           name,
+                                                                           &wp_presentation_interface,
+                                                                           version);
+                }
+                else if (std::string_view(interface) == wl_shm_interface.name) {
+                    shm_raw = (wl_shm*) wl_registry_bind(registry,
+                                                         name,
+                                                         &wl_shm_interface,
+                                                         1);
+                }
+                else if (std::string_view(interface) == wl_seat_interface.name && !seat_raw) {
+                    seat_raw = (wl_seat*) wl_registry_bind(registry,
+                                                           name,
+                                                           &wl_seat_interface,
+                                                           1);
+                }
+                else if (std::string_view(interface) == zwp_tablet_manager_v2_interface.name) {
+                    tablet_manager_raw = (zwp_tablet_manager_v2*) wl_registry_bind(registry,
+                                                                                   name,
+                                                                                   &zwp_tablet_manager_v2_interface,
+                                                                                   1);
+                }
+                else if (std::string_view(interface) == wl_output_interface.name) {
+                    static_cast<output_registry*>(data)->add(registry, name, version);
+                }
+            },
+            .global_remove = [](auto data, auto, auto name) noexcept {
+                static_cast<output_registry*>(data)->remove(name);
+            },
+        };
+        wl_registry_add_listener(registry.get(), &listener, &outputs);
+        startup.run("wayland-registry", [&] { return wl_display_roundtrip(display.get()); });
+        auto compositor = safe_ptr(compositor_raw);
+        auto shell = safe_ptr(shell_raw);
+        auto shm = shm_raw
+            ? safe_ptr(shm_raw)
+            : safe_ptr<wl_shm, wl_shm_destroy>();
+        if (shm) wl_proxy_set_queue((wl_proxy*) shm.get(), frame_queue.get());
+        auto presentation = presentation_raw
+            ? safe_ptr(presentation_raw)
+            : safe_ptr<wp_presentation, wp_presentation_destroy>();
+        presentation_stats latency;
+        wp_presentation_listener presentation_listener = {
+            .clock_id = [](auto data, auto, auto clock) noexcept {
+                static_cast<presentation_stats*>(data)->clock = static_cast<clockid_t>(clock);
+            },
+        };
+        if (presentation) {
+            wl_proxy_set_queue((wl_proxy*) presentation.get(), frame_queue.get());
+            wp_presentation_add_listener(presentation.get(), &presentation_listener, &latency);
+            wl_display_dispatch_pending(display.get());     // clock_id may already sit in the default queue
+            wl_display_roundtrip_queue(display.get(), frame_queue.get());
+        }
+
+        // One heap record per outstanding wp_presentation_feedback; the feedback is requested right
+        // before vkQueuePresentKHR so it latches onto the commit the WSI makes for that image.
+        // The feedback proxies inherit frame_queue, so these run on the event thread.
+        struct pending_feedback {
+            presentation_stats* stats;
+            std::chrono::nanoseconds input;
+            std::chrono::nanoseconds submit;
+        };
+        wp_presentation_feedback_listener feedback_listener = {
+            .sync_output = [](auto...) noexcept { },
+            .presented = [](auto data, auto feedback, auto sec_hi, auto sec_lo, auto nsec, auto, auto, auto, auto) noexcept {
+                auto pending = static_cast<pending_feedback*>(data);
+                auto presented = std::chrono::seconds((uint64_t(sec_hi) << 32) | sec_lo) + std::chrono::nanoseconds(nsec);
+                pending->stats->presented += 1;
+                pending->stats->input_to_present.push(presented - pending->input);
+                pending->stats->submit_to_present.push(presented - pending->submit);
+                wp_presentation_feedback_destroy(feedback);
+                delete pending;
+            },
+            .discarded = [](auto data, auto feedback) noexcept {
+                auto pending = static_cast<pending_feedback*>(data);
+                pending->stats->discarded += 1;
+                wp_presentation_feedback_destroy(feedback);
+                delete pending;
+            },
+        };
+        auto seat = seat_raw
+            ? safe_ptr(seat_raw)
+            : safe_ptr<wl_seat, wl_seat_destroy>();
+        auto tablet_manager = tablet_manager_raw
+            ? safe_ptr(tablet_manager_raw)
+            : safe_ptr<zwp_tablet_manager_v2, zwp_tablet_manager_v2_destroy>();
+        if (seat) wl_proxy_set_queue((wl_proxy*) seat.get(), input_queue.get());
+        if (tablet_manager) wl_proxy_set_queue((wl_proxy*) tablet_manager.get(), input_queue.get());
+        std::ofstream tablet_record;
+        tablet_input tablet;
+        if (!opts.record_tablet.empty()) {
+            tablet_record.open(opts.record_tablet);
+            tablet.record = &tablet_record;
+        }
+        auto tablet_seat = (seat && tablet_manager)
+            ? safe_ptr(zwp_tablet_manager_v2_get_tablet_seat(tablet_manager.get(), seat.get()))
+            : safe_ptr<zwp_tablet_seat_v2, zwp_tablet_seat_v2_destroy>();
+        if (tablet_seat) {
+            zwp_tablet_seat_v2_add_listener(tablet_seat.get(), &tablet_seat_listener, &tablet);
+        }
+        wl_proxy_set_queue((wl_proxy*) shell.get(), surface_queue.get());
+
+        zxdg_shell_v6_listener shell_listener = {
+            .ping = [](auto, auto shell, auto serial) noexcept {
+                zxdg_shell_v6_pong(shell, serial);
+            },
+        };
+        zxdg_shell_v6_add_listener(shell.get(), &shell_listener, nullptr);
+
+        // Sizes arrive in zxdg_toplevel_v6.configure and only take effect on the
+        // zxdg_surface_v6.configure that follows, which hands them to the render thread through
+        // `configured_extent`; `pending` and `extent` belong to whichever thread dispatches.
+        struct toplevel_state {
+            VkExtent2D pending = { 0, 0 };
+            VkExtent2D extent = { 0, 0 };
+            bool configured = false;
+            std::atomic<bool> closed = false;
+            latest_value<VkExtent2D> configured_extent;
+        };
+        zxdg_surface_v6_listener xdg_surface_listener = {
+            .configure = [](auto data, auto xdg_surface, auto serial) noexcept {
+                auto state = static_cast<toplevel_state*>(data);
+                zxdg_surface_v6_ack_configure(xdg_surface, serial);
+                if (state->pending.width != 0 && state->pending.height != 0 &&
+                    (state->pending.width != state->extent.width || state->pending.height != state->extent.height))
+                {
+                    state->extent = state->pending;
+                    state->configured_extent.publish(state->extent);
+                }
+                state->configured = true;
+            },
+        };
+        zxdg_toplevel_v6_listener toplevel_listener = {
+            .configure = [](auto data, auto, auto width, auto height, auto) noexcept {
+                auto state = static_cast<toplevel_state*>(data);
+                state->pending = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+            },
+            .close = [](auto data, auto) noexcept {
+                static_cast<toplevel_state*>(data)->closed = true;
+            },
+        };
+
+        // One toplevel per --windows, each with the outputs it is on and its own frame callback,
+        // so a hidden window stops drawing without holding up the others. Every callback also
+        // wakes the render thread through `wakeup`.
+        frame_wakeup wakeup{ 0 };
+        struct wayland_window {
+            explicit wayland_window(frame_wakeup& wakeup) noexcept : pacing(wakeup) { }
+            toplevel_state state;
+            surface_outputs outputs;
+            frame_pacer pacing;
+            VkExtent2D extent = { 1024, 768 };     // first configure; the render thread's from then on
+            // after the listener data, so these go first
+            decltype (safe_ptr<wl_surface, wl_surface_destroy>()) surface = safe_ptr<wl_surface, wl_surface_destroy>();
+            decltype (safe_ptr<zxdg_surface_v6, zxdg_surface_v6_destroy>()) xdg_surface = safe_ptr<zxdg_surface_v6, zxdg_surface_v6_destroy>();
+            decltype (safe_ptr<zxdg_toplevel_v6, zxdg_toplevel_v6_destroy>()) toplevel = safe_ptr<zxdg_toplevel_v6, zxdg_toplevel_v6_destroy>();
+        };
+        auto create_window = [&](uint32_t index) {
+            auto window = std::make_unique<wayland_window>(wakeup);
+            window->surface = safe_ptr(wl_compositor_create_surface(compositor.get()));
+            wl_proxy_set_queue((wl_proxy*) window->surface.get(), surface_queue.get());
+            window->outputs.attach(window->surface.get());
+            window->xdg_surface = safe_ptr(zxdg_shell_v6_get_xdg_surface(shell.get(), window->surface.get()));
+            zxdg_surface_v6_add_listener(window->xdg_surface.get(), &xdg_surface_listener, &window->state);
+            window->toplevel = safe_ptr(zxdg_surface_v6_get_toplevel(window->xdg_surface.get()));
+            zxdg_toplevel_v6_add_listener(window->toplevel.get(), &toplevel_listener, &window->state);
+            auto title = index == 0 ? std::string("wayland-vulkan") : "wayland-vulkan-" + std::to_string(index);
+            zxdg_toplevel_v6_set_title(window->toplevel.get(), title.c_str());
+            wl_surface_commit(window->surface.get());
+            return window;
+        };
+        std::vector<std::unique_ptr<wayland_window>> windows;
+        startup.run("xdg-configure", [&] {
+            for (uint32_t i = 0; i < opts.window_count; ++i) windows.push_back(create_window(i));
+            auto configured = [&] {
+                return std::all_of(windows.begin(), windows.end(), [](auto const& w) { return w->state.configured; });
+            };
+            while (!configured() && wl_display_dispatch_queue(display.get(), surface_queue.get()) != -1) continue;
+        });
+        for (auto& w : windows) {
+            if (auto configured = w->state.configured_extent.take()) w->extent = *configured;
+        }
+        // the software backend presents to the first window only
+        auto& window = windows.front()->state;
+        auto& surface = windows.front()->surface;
+        auto& extent = windows.front()->extent;
+
+        event_thread events(display.get(),
+                            { input_queue.get(), surface_queue.get(), frame_queue.get() },
+                            [&tablet] { tablet.flush(); });
+
+        // Pen samples are consumed once per frame; input-to-present then runs from the oldest
+        // sample this frame takes, moved onto the presentation clock.
+        auto take_pen_samples = [&](std::chrono::nanoseconds& input_time, clock::time_point now) {
+            tablet.drain([&, presentation_now = latency.now()](tablet_sample const& sample) {
+                auto age = now.time_since_epoch() - std::chrono::nanoseconds(sample.received);
+                input_time = std::min(input_time, presentation_now - std::chrono::duration_cast<std::chrono::nanoseconds>(age));
+            });
+        };
+
+        // wl_shm presentation for hosts without a usable Vulkan device. Same loop shape as the
+        // swapchain path (wait, acquire, record, present) and the same stats, but paced by
+        // wl_surface.frame callbacks since there is no present mode to block in.
+        auto run_software = [&]() -> int {
+            if (!shm) throw std::runtime_error("neither a vulkan device nor wl_shm is available...");
+            if (windows.size() > 1) std::cerr << "wl_shm presents to the first window only" << std::endl;
+            auto const& k = opts.scalar_raster ? scalar_kernels : best_kernels();
+            shm_swapchain chain(shm.get(), extent.width, extent.height);
+            std::counting_semaphore<1 << 16> frame_done{ 1 };
+            static wl_callback_listener const frame_listener = {
+                .done = [](auto data, auto callback, auto) noexcept {
+                    wl_callback_destroy(callback);
+                    static_cast<std::counting_semaphore<1 << 16>*>(data)->release();
+                },
+            };
+            // everything above may still be touched by listeners until the event thread is gone
+            auto stop_events = safe_ptr(&events, [](auto e) noexcept { e->stop(); });
+
+            std::vector<uint32_t> sprite_pixels(64 * 64);
+            for (int32_t y = 0; y < 64; ++y) {
+                for (int32_t x = 0; x < 64; ++x) {
+                    sprite_pixels[y * 64 + x] = ((x / 8 + y / 8) & 1) ? 0xffe0e0e0 : 0xff202020;
+                }
+            }
+            std::vector<uint32_t> panel_pixels(256 * 128, 0x80404040);     // premultiplied, half transparent
+            pixel_view const sprite = { sprite_pixels.data(), 64, 64, 64 };
+            pixel_view const panel = { panel_pixels.data(), 256, 128, 256 };
+
+            frame_stats stats { .frames_in_flight = 3, .present_mode = VK_PRESENT_MODE_FIFO_KHR };
+            uint64_t pixels = 0;
+            clock::duration raster_time = { };
+            for (uint64_t frame_number = 0;
+                 !interrupted && !window.closed && !events.disconnected() && (opts.frame_count == 0 || frame_number < opts.frame_count);)
+            {
+                auto t0 = clock::now();
+                auto input_time = latency.now();
+                // no callback within 100ms: the surface is hidden, so there is nothing to draw for
+                if (!frame_done.try_acquire_for(std::chrono::milliseconds(100))) continue;
+                while (frame_done.try_acquire()) continue;
+                auto t1 = clock::now();
+                take_pen_samples(input_time, t1);
+                if (auto next = window.configured_extent.take()) {
+                    chain.resize(static_cast<int32_t>(next->width), static_cast<int32_t>(next->height));
+                }
+                auto buffer = chain.acquire(std::chrono::milliseconds(100));
+                auto t2 = clock::now();
+                if (!buffer) {
+                    ++stats.dropped;
+                    frame_done.release();
+                    continue;
+                }
+
+                auto target = chain.view(*buffer);
+                auto const phase = static_cast<uint32_t>(frame_number % 256);
+                fill(k, target, { 0, 0, target.width, target.height }, 0xff000000 | (phase << 16) | (0x40 << 8) | (255 - phase));
+                auto const travel = std::max(target.width - sprite.width, 1);
+                blit(k, target, sprite, static_cast<int32_t>(frame_number * 4 % travel), target.height / 2 - sprite.height / 2);
+                blit(k, target, panel, 32, 32, true);
+                raster_time += clock::now() - t2;
+                pixels += uint64_t(target.width) * target.height + sprite.width * sprite.height + panel.width * panel.height;
+
+                chain.attach(surface.get(), *buffer);
+                wl_callback_add_listener(wl_surface_frame(surface.get()), &frame_listener, &frame_done);
+                if (presentation) {
+                    auto feedback = wp_presentation_feedback(presentation.get(), surface.get());
+                    wp_presentation_feedback_add_listener(feedback,
+                                                          &feedback_listener,
+                                                          new pending_feedback{ &latency, input_time, latency.now() });
+                }
+                wl_surface_commit(surface.get());
+                wl_display_flush(display.get());
+                stats.push(t1 - t0, t2 - t1, clock::now() - t2);
+                if (frame_number == 0) startup.mark("first-present");
+                ++frame_number;
+            }
+            stop_events.reset();
+            using seconds = std::chrono::duration<double>;
+            using us = std::chrono::duration<double, std::micro>;
+            auto const frames = std::max<size_t>(stats.samples.size(), 1);
+            std::cout << stats << std::endl;
+            std::cout << "(software-stats"
+                      << " (kernels " << k.name << ")"
+                      << " (pixels " << pixels << ")"
+                      << " (pixels-per-sec " << pixels / std::max(seconds(raster_time).count(), 1e-9) << ")"
+                      << " (raster-avg-us " << us(raster_time).count() / frames << "))" << std::endl;
+            std::cout << chain << std::endl;
+            std::cout << events << std::endl;
+            if (presentation) {
+                std::cout << latency << std::endl;
+            }
+            if (tablet_seat) {
+                std::cout << tablet << std::endl;
+            }
+            std::cout << startup << std::endl;
+            return 0;
+        };
+        if (opts.backend_shm) {
+            return run_software();
+        }
+
+        vk.emplace(startup.run("vulkan-join", [&] { return vulkan_ready.get(); }));
+        auto& instance = vk->instance;
+        auto& device = vk->device;
+        auto const& selection = vk->selection;
+        auto const physical_device = selection.physical_device;
+        bool const external_memory_host = vk->external_memory_host;
+        bool const incremental_present = vk->incremental_present;
+        if (!instance) {
+            std::cerr << "no vulkan instance, presenting through wl_shm" << std::endl;
+            return run_software();
+        }
+        if (physical_device == nullptr) {
+            std::cerr << "no physical device can present to this wayland display, presenting through wl_shm" << std::endl;
+            return run_software();
+        }
+        std::cout << selection << std::endl;
+        if (!device) {
+            std::cerr << "no vulkan device, presenting through wl_shm" << std::endl;
+            return run_software();
+        }
+        if (opts.bench_allocator || opts.bench_sycl) {
+            warmup.wait();      // keep pipeline compilation out of the measurement
+        }
+        if (opts.bench_allocator) {
+            allocator_benchmark(physical_device, device.get(), std::cout);
+            return 0;
+        }
+        device_allocator allocator(physical_device, device.get());
+        if (opts.bench_sycl) {
+            sycl_benchmark(physical_device, device.get(), allocator,
+                           get_queues(device.get(), selection).graphics, selection.graphics_family,
+                           selection.timeline_semaphore, external_memory_host, std::cout);
+            return 0;
+        }
+        // joined once the first frame is out; nothing before it depends on these pipelines
+        decltype (warmup.get()) pipeline_set;
+
+        auto create_surface = [&](wl_surface* surface) {
+            VkWaylandSurfaceCreateInfoKHR info = {
+                .sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR,
+                .pNext = nullptr,
+                .flags = 0,
+                .display = display.get(),
+                .surface = surface,
+            };
+            VkSurfaceKHR vk_surface = nullptr;
+            if (VK_SUCCESS != vkCreateWaylandSurfaceKHR(instance.get(), &info, nullptr, &vk_surface)) {
+                std::cerr << "vkCreateWaylandSurfaceKHR failed..." << std::endl;
+            }
+            return safe_ptr(vk_surface,
+                            [&](auto ptr) noexcept {
+                                vkDestroySurfaceKHR(instance.get(), ptr, nullptr);
+                            });
+        };
+
+        //std::cout << capabilities(physical_devices(instance.get()).front(), vk_surface.get()) << std::endl;
+
+        auto choose_present_mode = [&](VkSurfaceKHR surface) {
+            if (opts.low_latency) {
+                auto modes = present_modes(physical_device, surface);
+                for (auto mode : { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR }) {
+                    if (std::find(modes.begin(), modes.end(), mode) != modes.end()) return mode;
+                }
+            }
+            return VK_PRESENT_MODE_FIFO_KHR;
+        };
+
+        auto queues = get_queues(device.get(), selection);
+        auto queue = queues.graphics;
+
+        auto create_command_pool = [&] {
+            VkCommandPoolCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                .queueFamilyIndex = selection.graphics_family,
+            };
+            VkCommandPool pool = nullptr;
+            if (VK_SUCCESS != vkCreateCommandPool(device.get(), &info, nullptr, &pool)) {
+                std::cerr << "vkCreateCommandPool failed..." << std::endl;
+            }
+            return safe_ptr(pool);
+        };
+        auto command_pool = create_command_pool();
+
+        auto create_semaphore = [&] {
+            VkSemaphoreCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+            };
+            VkSemaphore semaphore = nullptr;
+            if (VK_SUCCESS != vkCreateSemaphore(device.get(), &info, nullptr, &semaphore)) {
+                std::cerr << "vkCreateSemaphore failed..." << std::endl;
+            }
+            return safe_ptr(semaphore);
+        };
+        auto create_fence = [&] {
+            VkFenceCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+            VkFence fence = nullptr;
+            if (VK_SUCCESS != vkCreateFence(device.get(), &info, nullptr, &fence)) {
+                std::cerr << "vkCreateFence failed..." << std::endl;
+            }
+            return safe_ptr(fence);
+        };
+
+        // One slot per frame in flight; slot i is reused only after its fence from N frames ago
+        // has signaled, so a window never gets more than N frames ahead of the GPU. `serial` is
+        // the retire queue's for that submission.
+        struct frame {
+            decltype (create_semaphore()) acquired;
+            decltype (create_semaphore()) rendered;
+            decltype (create_fence()) fence;
+            VkCommandBuffer command_buffer;
+            uint64_t serial = 0;
+        };
+        auto create_frames = [&] {
+            std::vector<VkCommandBuffer> command_buffers(opts.frames_in_flight);
+            VkCommandBufferAllocateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .commandPool = command_pool.get(),
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = opts.frames_in_flight,
+            };
+            if (VK_SUCCESS != vkAllocateCommandBuffers(device.get(), &info, command_buffers.data())) {
+                throw std::runtime_error("vkAllocateCommandBuffers failed...");
+            }
+            std::vector<frame> frames;
+            for (auto command_buffer : command_buffers) {
+                frames.push_back({ create_semaphore(), create_semaphore(), create_fence(), command_buffer });
+            }
+            return frames;
+        };
+
+        std::optional<gpu_profiler> profiler;
+        if (!opts.trace.empty()) {
+            profiler.emplace(physical_device, device.get(), selection.graphics_family, opts.frames_in_flight);
+        }
+
+        // Both passes are compatible and share the framebuffers: `clear` repaints a whole image whose
+        // old contents do not matter, `load` keeps the image and repaints only its dirty area.
+        auto create_render_pass = [&](bool load) {
+            VkAttachmentDescription attachment = {
+                .flags = 0,
+                .format = VK_FORMAT_R8G8B8A8_UNORM,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = load ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            };
+            VkAttachmentReference color = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+            VkSubpassDescription subpass = {
+                .flags = 0,
+                .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+                .inputAttachmentCount = 0,
+                .pInputAttachments = nullptr,
+                .colorAttachmentCount = 1,
+                .pColorAttachments = &color,
+                .pResolveAttachments = nullptr,
+                .pDepthStencilAttachment = nullptr,
+                .preserveAttachmentCount = 0,
+                .pPreserveAttachments = nullptr,
+            };
+            // orders the layout transition after the acquire semaphore wait
+            VkSubpassDependency dependency = {
+                .srcSubpass = VK_SUBPASS_EXTERNAL,
+                .dstSubpass = 0,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dependencyFlags = 0,
+            };
+            VkRenderPassCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .attachmentCount = 1,
+                .pAttachments = &attachment,
+                .subpassCount = 1,
+                .pSubpasses = &subpass,
+                .dependencyCount = 1,
+                .pDependencies = &dependency,
+            };
+            VkRenderPass pass = nullptr;
+            if (VK_SUCCESS != vkCreateRenderPass(device.get(), &info, nullptr, &pass)) {
+                throw std::runtime_error("vkCreateRenderPass failed...");
+            }
+            return safe_ptr(pass);
+        };
+        auto clear_pass = create_render_pass(false);
+        auto load_pass = create_render_pass(true);
+
+        // image view + framebuffer per swapchain image; replaced together with the swapchain
+        auto create_image_view = [&](VkImage image) {
+            VkImageViewCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .image = image,
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = VK_FORMAT_R8G8B8A8_UNORM,
+                .components = { },
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+            };
+            VkImageView view = nullptr;
+            if (VK_SUCCESS != vkCreateImageView(device.get(), &info, nullptr, &view)) {
+                std::cerr << "vkCreateImageView failed..." << std::endl;
+            }
+            return safe_ptr(view);
+        };
+        auto create_framebuffer = [&](VkImageView view, VkExtent2D extent) {
+            VkFramebufferCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .renderPass = clear_pass.get(),
+                .attachmentCount = 1,
+                .pAttachments = &view,
+                .width = extent.width,
+                .height = extent.height,
+                .layers = 1,
+            };
+            VkFramebuffer framebuffer = nullptr;
+            if (VK_SUCCESS != vkCreateFramebuffer(device.get(), &info, nullptr, &framebuffer)) {
+                std::cerr << "vkCreateFramebuffer failed..." << std::endl;
+            }
+            return safe_ptr(framebuffer);
+        };
+        struct target {
+            decltype (create_image_view(nullptr)) view;
+            decltype (create_framebuffer(nullptr, { })) framebuffer;
+        };
+
+        // Everything one window presents with. The device, queue, command pool, render passes,
+        // allocator and pipelines are shared; only the render thread touches any of this.
+        struct presenter {
+            wayland_window* window;
+            decltype (create_surface(nullptr)) surface;
+            VkPresentModeKHR present_mode;
+            VkExtent2D extent;                          // logical, from the last configure
+            int32_t scale = 1;                          // buffer scale the swapchain was made for
+            gpu_profiler* profiler = nullptr;           // the first window's frames only
+            bool primary = false;                       // gets the SYCL stage and the pen samples
+            retire_queue* retired = nullptr;
+            VkExtent2D swapchain_extent = { };
+            vk_ptr<VkSwapchainKHR_T> swapchain;
+            std::vector<VkImage> images;
+            std::vector<target> targets;
+            std::vector<frame> frames;
+            damage_tracker damage;
+            frame_stats stats;
+            uint64_t frame_number = 0;
+            clock::time_point idle_since = clock::now();
+            std::optional<VkExtent2D> storm_extent;     // --resize-storm, for the next frame
+            bool unmapped = false;
+            bool capturable = false;                    // swapchain images can be copied from
+
+            // The swapchain must be gone before `surface` is, also when unwinding past a
+            // half-made presenter; the retire queue would only get to it with the device.
+            ~presenter() {
+                swapchain.reset();
+                if (retired) retired->drain();
+            }
+        };
+
+        // --capture reads back the first window's frames
+        std::optional<frame_capture> capture;
+        if (!opts.capture.empty()) {
+            capture.emplace(device.get(), allocator, opts.capture, parse_capture_format(opts.capture_format),
+                            opts.capture_every, opts.frames_in_flight, opts.frames_in_flight + 3, opts.capture_drop);
+        }
+
+        // The buffer is `scale` times the configured (logical) size, clamped to what the surface
+        // allows; passing the previous swapchain lets the driver recycle its images instead of
+        // reallocating them.
+        auto create_swapchain = [&](presenter& p, VkSwapchainKHR old) {
+            auto caps = capabilities(physical_device, p.surface.get());
+            VkExtent2D extent = { p.extent.width * uint32_t(p.scale), p.extent.height * uint32_t(p.scale) };
+            if (caps.currentExtent.width != UINT32_MAX) {
+                extent = caps.currentExtent;
+            }
+            extent.width = std::clamp(extent.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+            extent.height = std::clamp(extent.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+            // MAILBOX needs one image beyond what the compositor may hold to never block;
+            // IMMEDIATE and FIFO get by with the minimum (but at least double buffering).
+            auto image_count = std::max<uint32_t>(caps.minImageCount + (p.present_mode == VK_PRESENT_MODE_MAILBOX_KHR), 2);
+            if (caps.maxImageCount != 0) {
+                image_count = std::min(image_count, caps.maxImageCount);
+            }
+            VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            bool const capturable = capture && p.primary && (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            if (capturable) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            // we render upright; only ask for a transform the surface reports (Wayland WSI: IDENTITY)
+            auto const transform = (caps.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+                ? VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : caps.currentTransform;
+            VkSwapchainKHR swapchain = nullptr;
+            VkSwapchainCreateInfoKHR info = {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+                .pNext = nullptr,
+                .flags = 0,
+                .surface = p.surface.get(),
+                .minImageCount = image_count,
+                .imageFormat = VK_FORMAT_R8G8B8A8_UNORM,
+                .imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
+                .imageExtent = extent,
+                .imageArrayLayers = 1,
+                .imageUsage = usage,
+                .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+                .preTransform = transform,
+                .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+                .presentMode = p.present_mode,
+                .clipped = VK_TRUE,
+                .oldSwapchain = old,
+            };
+            if (auto ret = vkCreateSwapchainKHR(device.get(), &info, nullptr, &swapchain); ret != VK_SUCCESS) {
+                std::cerr << "vkCreateSwapchainKHR failed..." << std::endl;
+            }
+            else {
+                p.swapchain_extent = extent;
+                p.capturable = capturable;
+            }
+            return swapchain;
+        };
+
+        auto swapchain_images = [&](presenter const& p) {
+            uint32_t count = 0;
+            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device.get(), p.swapchain.get(), &count, nullptr)) {
+                //...
+            }
+            std::vector<VkImage> images(count);
+            if (VK_SUCCESS != vkGetSwapchainImagesKHR(device.get(), p.swapchain.get(), &count, images.data())) {
+                //...
+            }
+            return images;
+        };
+        auto create_targets = [&](presenter const& p) {
+            std::vector<target> targets;
+            for (auto image : p.images) {
+                auto view = create_image_view(image);
+                auto framebuffer = create_framebuffer(view.get(), p.swapchain_extent);
+                targets.push_back({ std::move(view), std::move(framebuffer) });
+            }
+            return targets;
+        };
+
+        // The largest scale of the outputs the window is on, so it is sharp on each of them;
+        // wl_surface.set_buffer_scale keeps the compositor from scaling the bigger buffer up
+        // again and takes effect with the WSI's commit of the next present.
+        auto apply_scale = [&](presenter& p) {
+            p.scale = p.window->outputs.scale();
+            auto surface = p.window->surface.get();
+            if (wl_surface_get_version(surface) >= WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION) {
+                wl_surface_set_buffer_scale(surface, p.scale);
+            }
+        };
+
+        auto create_presenter = [&](wayland_window& window, bool primary) {
+            auto surface = create_surface(window.surface.get());
+            if (VkBool32 supported = VK_FALSE;
+                VK_SUCCESS != vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, selection.graphics_family, surface.get(), &supported) ||
+                !supported)
+            {
+                throw std::runtime_error("selected queue family cannot present to the surface...");
+            }
+            auto const present_mode = choose_present_mode(surface.get());
+            auto p = std::unique_ptr<presenter>(new presenter{
+                    .window = &window,
+                    .surface = std::move(surface),
+                    .present_mode = present_mode,
+                    .extent = window.extent,
+                    .profiler = (primary && profiler) ? &*profiler : nullptr,
+                    .primary = primary,
+                    .retired = vk->retired.get(),
+                    .stats = { .frames_in_flight = opts.frames_in_flight, .present_mode = present_mode },
+                });
+            apply_scale(*p);
+            p->swapchain = safe_ptr(create_swapchain(*p, nullptr));
+            p->images = swapchain_images(*p);
+            p->targets = create_targets(*p);
+            p->frames = create_frames();
+            p->damage.incremental_present = incremental_present;
+            p->damage.reset(p->images.size(), p->swapchain_extent);
+            return p;
+        };
+
+        // The scene: a background (animated unless --scene=cursor) and, in the cursor scene, a
+        // small rect crossing the frame. Only `region` of the image is repainted; a region that
+        // is the whole image goes through the clear pass, anything smaller through the load pass
+        // with the clears confined to the dirty rects.
+        auto cursor_at = [&](presenter const& p, uint64_t frame_number) -> VkRect2D {
+            constexpr uint32_t size = 32;
+            auto const travel = std::max(p.swapchain_extent.width, size + 1) - size;
+            auto const x = static_cast<int32_t>(frame_number * 6 % travel);
+            auto const y = static_cast<int32_t>(p.swapchain_extent.height / 2 + 100 * std::sin(frame_number / 30.0)) - int32_t(size / 2);
+            return { { x, y }, { size, size } };
+        };
+        auto draw = [&](presenter const& p, VkCommandBuffer cmd, uint32_t idx, uint64_t frame_number, std::span<VkRect2D const> region) {
+            float phase = opts.cursor_scene ? 0.1f : static_cast<float>(frame_number % 256) / 255.0f;
+            VkClearValue background = { .color = {{ phase, 0.25f, 1.0f - phase, 1.0f }} };
+            bool const full = p.damage.full(region);
+            auto const area = bounds(region);
+            VkRenderPassBeginInfo begin = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .pNext = nullptr,
+                .renderPass = full ? clear_pass.get() : load_pass.get(),
+                .framebuffer = p.targets[idx].framebuffer.get(),
+                .renderArea = area,
+                .clearValueCount = 1,
+                .pClearValues = &background,
+            };
+            vkCmdBeginRenderPass(cmd, &begin, VK_SUBPASS_CONTENTS_INLINE);
+            auto clear = [&](VkClearValue value, std::span<VkRect2D const> rects) {
+                VkClearAttachment attachment = { VK_IMAGE_ASPECT_COLOR_BIT, 0, value };
+                std::vector<VkClearRect> clear_rects;
+                for (auto const& r : rects) clear_rects.push_back({ r, 0, 1 });
+                vkCmdClearAttachments(cmd, 1, &attachment, static_cast<uint32_t>(clear_rects.size()), clear_rects.data());
+            };
+            if (!full) {
+                clear(background, region);
+            }
+            if (opts.cursor_scene) {
+                auto cursor = clip(cursor_at(p, frame_number), p.swapchain_extent);
+                cursor = clip({ { cursor.offset.x - area.offset.x, cursor.offset.y - area.offset.y }, cursor.extent }, area.extent);
+                cursor.offset.x += area.offset.x;
+                cursor.offset.y += area.offset.y;
+                if (!empty(cursor)) {
+                    clear({ .color = {{ 1.0f, 0.9f, 0.2f, 1.0f }} }, std::span(&cursor, 1));
+                }
+            }
+            vkCmdEndRenderPass(cmd);
+        };
+
+        // the presented image, as the last command of its frame
+        auto capture_image = [&](presenter const& p, VkCommandBuffer cmd, uint32_t idx, uint64_t frame_number) {
+            if (!capture || !p.capturable || !capture->wants(frame_number)) return;
+            gpu_profiler::zone zone(p.profiler, cmd, "capture");
+            capture->record(cmd, frame_number % p.frames.size(), frame_number, p.images[idx],
+                            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_FORMAT_R8G8B8A8_UNORM, p.swapchain_extent);
+        };
+
+        auto record = [&](presenter const& p, VkCommandBuffer cmd, uint32_t idx, uint64_t frame_number, VkBuffer source, std::span<VkRect2D const> region) {
+            auto image = p.images[idx];
+            auto const prof = p.profiler;
+            VkCommandBufferBeginInfo begin = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = nullptr,
+            };
+            vkBeginCommandBuffer(cmd, &begin);
+            if (prof) prof->begin_frame(cmd, frame_number % p.frames.size());
+            if (!source) {
+                {
+                    gpu_profiler::zone zone(prof, cmd, "draw");
+                    draw(p, cmd, idx, frame_number, region);
+                }
+                capture_image(p, cmd, idx, frame_number);
+                vkEndCommandBuffer(cmd);
+                return;
+            }
+            std::optional<gpu_profiler::zone> zone(std::in_place, prof, cmd, "upload");
+            VkImageSubresourceRange range = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            };
+            VkImageMemoryBarrier to_transfer = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .pNext = nullptr,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = image,
+                .subresourceRange = range,
+            };
+            vkCmdPipelineBarrier(cmd,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &to_transfer);
+            VkBufferImageCopy copy = {
+                .bufferOffset = 0,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+                .imageOffset = { 0, 0, 0 },
+                .imageExtent = { p.swapchain_extent.width, p.swapchain_extent.height, 1 },
+            };
+            vkCmdCopyBufferToImage(cmd, source, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+            VkImageMemoryBarrier to_present = to_transfer;
+            to_present.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            to_present.dstAccessMask = 0;
+            to_present.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            to_present.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            vkCmdPipelineBarrier(cmd,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &to_present);
+            zone.reset();
+            capture_image(p, cmd, idx, frame_number);
+            vkEndCommandBuffer(cmd);
+        };
+
+        std::optional<sycl_stage> compute_stage;
+        if (opts.sycl) {
+            compute_stage.emplace(physical_device, device.get(), allocator, opts.frames_in_flight,
+                                  selection.timeline_semaphore, external_memory_host && !opts.sycl_staging);
+        }
+
+        // The replaced swapchain, views and framebuffers go to the retire queue, so a resize never
+        // needs vkDeviceWaitIdle; a scale change from wl_surface.enter/leave is a resize too.
+        auto& retired = *vk->retired;
+        auto recreate_swapchain = [&](presenter& p) {
+            apply_scale(p);
+            auto next = create_swapchain(p, p.swapchain.get());
+            if (next == nullptr) return;
+            p.swapchain.reset(next);
+            p.images = swapchain_images(p);
+            p.targets = create_targets(p);
+            p.damage.reset(p.images.size(), p.swapchain_extent);
+            ++p.stats.recreated;
+        };
+        constexpr VkExtent2D storm_extents[] = { { 640, 480 }, { 800, 600 }, { 1280, 720 }, { 1024, 768 } };
+
+        std::vector<std::unique_ptr<presenter>> presenters;
+        for (auto& w : windows) presenters.push_back(create_presenter(*w, presenters.empty()));
+
+        // One frame of one window, if it can make one without blocking: its frame callback has
+        // come back (a hidden or occluded window gets none), its oldest frame slot is free and an
+        // image is ready. Anything else returns at once so the next window gets its turn.
+        enum class step { presented, waiting, busy, failed };
+        auto render_frame = [&](presenter& p) -> step {
+            if (!p.window->pacing.ready()) return step::waiting;
+            auto& frame = p.frames[p.frame_number % p.frames.size()];
+            auto fence = frame.fence.get();
+            if (auto status = vkGetFenceStatus(device.get(), fence); status == VK_NOT_READY) {
+                return step::busy;
+            }
+            else if (status != VK_SUCCESS) {
+                std::cerr << "vkGetFenceStatus failed: " << status << std::endl;
+                return step::failed;
+            }
+
+            // `wait` is everything since this window's previous present: GPU, compositor and
+            // the other windows' turns
+            auto t0 = p.idle_since;
+            auto input_time = latency.now();
+            auto t1 = clock::now();
+            if (p.primary) take_pen_samples(input_time, t1);
+            retired.collect(frame.serial);
+            auto const slot = p.frame_number % p.frames.size();
+            if (capture && p.primary) capture->begin_frame(slot);
+
+            auto next_extent = p.window->state.configured_extent.take();
+            if (p.storm_extent) next_extent = std::exchange(p.storm_extent, std::nullopt);
+            if (next_extent) p.extent = *next_extent;
+            if (next_extent || p.window->outputs.scale() != p.scale) {
+                recreate_swapchain(p);
+            }
+            uint32_t idx = 0;
+            auto ret = vkAcquireNextImageKHR(device.get(),
+                                             p.swapchain.get(),
+                                             0,
+                                             frame.acquired.get(),
+                                             nullptr,
+                                             &idx);
+            auto t2 = clock::now();
+            if (p.profiler) {
+                p.profiler->cpu_span("wait", t0, t1);
+                p.profiler->cpu_span("acquire", t1, t2);
+            }
+            if (ret == VK_NOT_READY || ret == VK_TIMEOUT) {
+                return step::waiting;       // the compositor still holds every image
+            }
+            if (ret == VK_ERROR_OUT_OF_DATE_KHR) {
+                ++p.stats.dropped;
+                recreate_swapchain(p);
+                return step::waiting;
+            }
+            if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR) {
+                std::cerr << "vkAcquireNextImageKHR failed: " << ret << std::endl;
+                return step::failed;
+            }
+            vkResetFences(device.get(), 1, &fence);
+
+            auto source = compute_stage && p.primary
+                ? compute_stage->produce(slot, p.swapchain_extent, p.frame_number)
+                : sycl_stage::output{ };
+            // what changed since the previous frame; the SYCL output and the animated
+            // background change everywhere, and the first frame has no previous one
+            if (source.buffer || !opts.cursor_scene || !opts.damage || p.frame_number == 0) {
+                p.damage.add_full();
+            }
+            else {
+                p.damage.add(cursor_at(p, p.frame_number - 1));
+                p.damage.add(cursor_at(p, p.frame_number));
+            }
+            auto const dirty = opts.damage ? p.damage.region(idx) : p.damage.frame_damage();
+            std::vector<VkRect2D> region(dirty.begin(), dirty.end());
+            {
+                gpu_profiler::cpu_zone zone(p.profiler, "record");
+                record(p, frame.command_buffer, idx, p.frame_number, source.buffer, region);
+            }
+            // the SYCL output is waited on through its timeline value; the binary acquire
+            // semaphore's value is ignored
+            semaphore_wait waits[] = {
+                { frame.acquired.get(), 0,
+                  source.buffer ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+                { source.ready, source.value, VK_PIPELINE_STAGE_TRANSFER_BIT },
+            };
+            semaphore_signal signals[] = { { frame.rendered.get(), 0 } };
+            if (p.profiler) p.profiler->submitted(slot);
+            frame.serial = retired.submitted();
+            if (VK_SUCCESS != submit(queue,
+                                     std::span(&frame.command_buffer, 1),
+                                     std::span(waits, source.ready ? 2 : 1),
+                                     signals,
+                                     fence))
+            {
+                std::cerr << "vkQueueSubmit failed..." << std::endl;
+                return step::failed;
+            }
+            auto const surface = p.window->surface.get();
+            if (presentation) {
+                auto feedback = wp_presentation_feedback(presentation.get(), surface);
+                wp_presentation_feedback_add_listener(feedback,
+                                                      &feedback_listener,
+                                                      new pending_feedback{ &latency, input_time, latency.now() });
+            }
+            p.window->pacing.request(surface);
+            VkSwapchainKHR swapchains[] = { p.swapchain.get() };
+            VkSemaphore const rendered = frame.rendered.get();
+            // damage relative to the previously presented frame, not the image's repainted region
+            std::vector<VkRectLayerKHR> present_rects;
+            for (auto const& r : p.damage.frame_damage()) present_rects.push_back({ r.offset, r.extent, 0 });
+            VkPresentRegionKHR present_region = {
+                .rectangleCount = static_cast<uint32_t>(present_rects.size()),
+                .pRectangles = present_rects.data(),
+            };
+            VkPresentRegionsKHR present_regions = {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+                .pNext = nullptr,
+                .swapchainCount = 1,
+                .pRegions = &present_region,
+            };
+            VkPresentInfoKHR present = {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .pNext = incremental_present ? &present_regions : nullptr,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &rendered,
+                .swapchainCount = std::size(swapchains),
+                .pSwapchains = swapchains,
+                .pImageIndices = &idx,
+                .pResults = nullptr,
+            };
+            {
+                gpu_profiler::cpu_zone zone(p.profiler, "present");
+                ret = vkQueuePresentKHR(queue, &present);
+            }
+            p.damage.presented(idx, region);
+            if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR) {
+                if (ret == VK_ERROR_OUT_OF_DATE_KHR) {
+                    ++p.stats.dropped;
+                    p.window->pacing.cancel();      // nothing was committed to call back for
+                }
+                recreate_swapchain(p);
+            }
+            else if (ret != VK_SUCCESS) {
+                std::cerr << "vkQueuePresentKHR failed: " << ret << std::endl;
+                return step::failed;
+            }
+            auto t3 = clock::now();
+            p.stats.push(t1 - t0, t2 - t1, t3 - t2);
+            p.idle_since = t3;
+            if (opts.resize_storm != 0 && p.frame_number % opts.resize_storm == opts.resize_storm - 1) {
+                p.storm_extent = storm_extents[(p.frame_number / opts.resize_storm) % std::size(storm_extents)];
+            }
+            ++p.frame_number;
+            return step::presented;
+        };
+
+        // Round-robin over the windows, never blocking on any one of them; only when none could
+        // make progress does the thread sleep, until one of their fences signals or a frame
+        // callback comes back. A closed window is unmapped and skipped from then on.
+        std::vector<VkFence> busy;
+        for (bool done = false; !done && !interrupted && !events.disconnected();) {
+            while (wakeup.try_acquire()) continue;
+            busy.clear();
+            bool open = false;
+            bool progressed = false;
+            for (auto& p : presenters) {
+                if (p->window->state.closed) {
+                    if (!std::exchange(p->unmapped, true)) {
+                        // the WSI owns the attached buffers until its swapchain is destroyed
+                        p->targets.clear();
+                        p->images.clear();
+                        p->swapchain.reset();
+                        retired.drain();
+                        wl_surface_attach(p->window->surface.get(), nullptr, 0, 0);
+                        wl_surface_commit(p->window->surface.get());
+                        wl_display_flush(display.get());
+                    }
+                    continue;
+                }
+                open = true;
+                switch (render_frame(*p)) {
+                case step::presented:
+                    progressed = true;
+                    break;
+                case step::busy:
+                    busy.push_back(p->frames[p->frame_number % p->frames.size()].fence.get());
+                    break;
+                case step::waiting:
+                    break;
+                case step::failed:
+                    done = true;
+                    break;
+                }
+                if (opts.frame_count != 0 && p->frame_number >= opts.frame_count) done = true;
+            }
+            if (!open) break;
+            if (progressed) {
+                if (warmup.valid()) {
+                    startup.mark("first-present");
+                    if (auto ready = startup.run("pipeline-join", [&] { return warmup.get(); })) pipeline_set.emplace(std::move(*ready));
+                }
+                continue;
+            }
+            if (!busy.empty()) {
+                vkWaitForFences(device.get(), static_cast<uint32_t>(busy.size()), busy.data(), VK_FALSE, 1'000'000);
+            }
+            else {
+                wakeup.try_acquire_for(std::chrono::milliseconds(4));
+            }
+        }
+        if (warmup.valid()) {
+            if (auto ready = warmup.get()) pipeline_set.emplace(std::move(*ready));
+        }
+        events.stop();
+        for (auto const& p : presenters) {
+            std::cout << p->stats << std::endl;
+            std::cout << p->damage << std::endl;
+            std::cout << p->window->outputs << std::endl;
+            std::cout << p->window->pacing << std::endl;
+        }
+        std::cout << outputs << std::endl;
+        std::cout << events << std::endl;
+        if (presentation) {
+            std::cout << latency << std::endl;
+        }
+        if (tablet_seat) {
+            std::cout << tablet << std::endl;
+        }
+        if (compute_stage) {
+            std::cout << *compute_stage << std::endl;
+        }
+        std::cout << allocator.stats() << std::endl;
+        std::cout << retired << std::endl;
+        if (pipeline_set) {
+            std::cout << *pipeline_set->first << std::endl;
+        }
+        std::cout << startup << std::endl;
+
+        // wait to clean up; each presenter drains its swapchain before its VkSurfaceKHR goes
+        while (vkDeviceWaitIdle(device.get()) != VK_SUCCESS) continue;
+        if (capture) {
+            capture->finish();
+            std::cout << *capture << std::endl;
+        }
+        presenters.clear();
+        if (profiler) {
+            profiler->flush();
+            std::ofstream trace(opts.trace);
+            profiler->write_trace(trace);
+            std::cout << *profiler << std::endl;
+        }
+        if (vk->messages) {
+            std::cout << *vk->messages << std::endl;
+            if (vk->messages->errors() > 0) return 1;
+        }
         return 0;
     }
     catch (std::exception& ex) {
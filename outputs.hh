@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <vector>
+
+#include <wayland-client.h>
+
+inline namespace output
+{
+    // One wl_output global. Its properties arrive as a burst that `done` (version 2) commits;
+    // they are written by whichever thread dispatches the default queue (the event thread once it
+    // runs) and read by the render thread.
+    struct output_info {
+        uint32_t name = 0;
+        uint32_t version = 1;
+        wl_output* proxy = nullptr;
+        std::atomic<int32_t> scale = 1;
+        std::atomic<int32_t> refresh_mhz = 0;       // current mode, 0 until known
+        std::atomic<bool> removed = false;
+        int32_t pending_scale = 1;
+        int32_t pending_refresh = 0;
+    };
+
+    // Every wl_output the registry announced, for as long as the connection lives. Entries are
+    // never freed before the registry is, so a surface may keep pointers to them; an unplugged
+    // output is only marked removed (the compositor sends wl_surface.leave for it anyway).
+    class output_registry {
+    public:
+        output_registry() = default;
+        output_registry(output_registry const&) = delete;
+        output_registry& operator=(output_registry const&) = delete;
+        ~output_registry() {
+            for (auto& o : outputs) wl_output_destroy(o->proxy);
+        }
+
+        void add(wl_registry* registry, uint32_t name, uint32_t version) {
+            auto info = std::make_unique<output_info>();
+            info->name = name;
+            info->version = std::min(version, 2u);
+            info->proxy = static_cast<wl_output*>(wl_registry_bind(registry, name, &wl_output_interface, info->version));
+            wl_output_add_listener(info->proxy, &listener, info.get());
+            std::lock_guard lock(mutex);
+            outputs.push_back(std::move(info));
+        }
+        void remove(uint32_t name) noexcept {
+            std::lock_guard lock(mutex);
+            for (auto& o : outputs) {
+                if (o->name == name) o->removed = true;
+            }
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, output_registry const& registry) noexcept {
+            std::lock_guard lock(registry.mutex);
+            output << "(outputs";
+            for (auto const& o : registry.outputs) {
+                output << " (output " << o->name
+                       << " (scale " << o->scale.load() << ")"
+                       << " (refresh-mhz " << o->refresh_mhz.load() << ")"
+                       << (o->removed ? " removed)" : ")");
+            }
+            return output << ")";
+        }
+
+    private:
+        static void commit(output_info* info) noexcept {
+            info->scale.store(std::max(info->pending_scale, 1), std::memory_order_relaxed);
+            info->refresh_mhz.store(info->pending_refresh, std::memory_order_relaxed);
+        }
+        static wl_output_listener const listener;
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<output_info>> outputs;
+    };
+    inline wl_output_listener const output_registry::listener = {
+        .geometry = [](auto...) noexcept { },
+        .mode = [](auto data, auto, auto flags, auto, auto, auto refresh) noexcept {
+            if ((flags & WL_OUTPUT_MODE_CURRENT) == 0) return;
+            auto info = static_cast<output_info*>(data);
+            info->pending_refresh = refresh;
+            if (info->version < 2) commit(info);        // no `done` to wait for
+        },
+        .done = [](auto data, auto) noexcept {
+            commit(static_cast<output_info*>(data));
+        },
+        .scale = [](auto data, auto, auto factor) noexcept {
+            static_cast<output_info*>(data)->pending_scale = factor;
+        },
+    };
+
+    // The outputs one surface is on, from wl_surface.enter/leave. A surface spanning several is
+    // rendered at the largest scale, so it is sharp everywhere, and reports the fastest refresh,
+    // which is the one the compositor usually paces its frame callbacks to.
+    class surface_outputs {
+    public:
+        void attach(wl_surface* surface) { wl_surface_add_listener(surface, &listener, this); }
+
+        int32_t scale() const noexcept {
+            std::lock_guard lock(mutex);
+            int32_t result = 1;
+            for (auto o : entered) result = std::max(result, o->scale.load(std::memory_order_relaxed));
+            return result;
+        }
+        int32_t refresh_mhz() const noexcept {
+            std::lock_guard lock(mutex);
+            int32_t result = 0;
+            for (auto o : entered) result = std::max(result, o->refresh_mhz.load(std::memory_order_relaxed));
+            return result;
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, surface_outputs const& outputs) noexcept {
+            size_t count = 0;
+            {
+                std::lock_guard lock(outputs.mutex);
+                count = outputs.entered.size();
+            }
+            return output << "(surface-outputs"
+                          << " (entered " << count << ")"
+                          << " (scale " << outputs.scale() << ")"
+                          << " (refresh-mhz " << outputs.refresh_mhz() << "))";
+        }
+
+    private:
+        static wl_surface_listener const listener;
+
+        mutable std::mutex mutex;
+        std::vector<output_info const*> entered;
+    };
+    inline wl_surface_listener const surface_outputs::listener = {
+        .enter = [](auto data, auto, auto output) noexcept {
+            auto self = static_cast<surface_outputs*>(data);
+            auto info = static_cast<output_info const*>(wl_output_get_user_data(output));
+            std::lock_guard lock(self->mutex);
+            if (info && std::find(self->entered.begin(), self->entered.end(), info) == self->entered.end()) {
+                self->entered.push_back(info);
+            }
+        },
+        .leave = [](auto data, auto, auto output) noexcept {
+            auto self = static_cast<surface_outputs*>(data);
+            auto info = static_cast<output_info const*>(wl_output_get_user_data(output));
+            std::lock_guard lock(self->mutex);
+            self->entered.erase(std::remove(self->entered.begin(), self->entered.end(), info), self->entered.end());
+        },
+    };
+
+    using frame_wakeup = std::counting_semaphore<1 << 16>;
+
+    // wl_surface.frame throttling for one surface. request() goes right before the commit
+    // (vkQueuePresentKHR's, inside the WSI) and `done` comes back once the compositor wants the
+    // next frame, which it never does while the surface is hidden or fully occluded. Drawing only
+    // when ready() also keeps the WSI's own FIFO throttle, which waits for the same commit's
+    // callback, from ever blocking the render thread on a window nobody can see.
+    class frame_pacer {
+    public:
+        explicit frame_pacer(frame_wakeup& wakeup) noexcept : wakeup(wakeup) { }
+        frame_pacer(frame_pacer const&) = delete;
+        frame_pacer& operator=(frame_pacer const&) = delete;
+
+        bool ready() const noexcept { return outstanding.load(std::memory_order_acquire) == nullptr; }
+        void request(wl_surface* surface) {
+            auto callback = wl_surface_frame(surface);
+            outstanding.store(callback, std::memory_order_release);
+            wl_callback_add_listener(callback, &listener, this);
+        }
+        // The commit the callback was for never happened; it rides on the next one instead. It is
+        // not destroyed here, the event thread may be dispatching it: its `done`, whenever it
+        // comes, no longer matches `outstanding` and is dropped.
+        void cancel() noexcept { outstanding.store(nullptr, std::memory_order_release); }
+
+        // read once the event thread is gone
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, frame_pacer const& pacer) noexcept {
+            auto const intervals = std::max<uint64_t>(pacer.callbacks, 2) - 1;
+            return output << "(frame-callbacks"
+                          << " (count " << pacer.callbacks << ")"
+                          << " (interval-avg-ms " << double(pacer.last_ms - pacer.first_ms) / double(intervals) << "))";
+        }
+
+    private:
+        static wl_callback_listener const listener;
+
+        frame_wakeup& wakeup;
+        std::atomic<wl_callback*> outstanding = nullptr;   // the live request, null when ready
+        uint64_t callbacks = 0;                 // event thread
+        uint32_t first_ms = 0;
+        uint32_t last_ms = 0;
+    };
+    inline wl_callback_listener const frame_pacer::listener = {
+        .done = [](auto data, auto callback, auto time_ms) noexcept {
+            auto self = static_cast<frame_pacer*>(data);
+            // compared before the destroy, which frees the address for the next request
+            wl_callback* expected = callback;
+            bool const current = self->outstanding.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+            wl_callback_destroy(callback);
+            if (!current) return;               // canceled
+            if (self->callbacks++ == 0) self->first_ms = time_ms;
+            self->last_ms = time_ms;
+            self->wakeup.release();
+        },
+    };
+} // ::output
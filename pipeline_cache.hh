@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+inline namespace pipeline
+{
+    // On-disk layout: our own header (so driverVersion is checked too, which the Vulkan header
+    // does not carry), followed by the blob from vkGetPipelineCacheData unchanged.
+    struct cache_file_header {
+        char magic[4];
+        uint32_t driver_version;
+        uint64_t data_size;
+        uint64_t checksum;
+    };
+    inline constexpr char cache_file_magic[4] = { 'W', 'V', 'P', 'C' };
+
+    inline uint64_t fnv1a(void const* data, size_t size) noexcept {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (auto p = static_cast<unsigned char const*>(data), end = p + size; p != end; ++p) {
+            hash = (hash ^ *p) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    inline std::filesystem::path default_cache_path() {
+        std::filesystem::path dir;
+        if (auto xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) dir = xdg;
+        else if (auto home = std::getenv("HOME"); home && *home) dir = std::filesystem::path(home) / ".cache";
+        else dir = std::filesystem::temp_directory_path();
+        return dir / "wayland-vulkan" / "pipeline-cache.bin";
+    }
+
+    // Checks the Vulkan pipeline cache header (VkPipelineCacheHeaderVersionOne) against the device
+    // that is about to consume it; a blob from another driver/GPU is discarded, not fed back.
+    inline bool valid_cache_blob(std::vector<char> const& blob, VkPhysicalDeviceProperties const& props) noexcept {
+        uint32_t header_size, header_version, vendor_id, device_id;
+        uint8_t uuid[VK_UUID_SIZE];
+        if (blob.size() < 16 + VK_UUID_SIZE) return false;
+        std::memcpy(&header_size, blob.data() + 0, 4);
+        std::memcpy(&header_version, blob.data() + 4, 4);
+        std::memcpy(&vendor_id, blob.data() + 8, 4);
+        std::memcpy(&device_id, blob.data() + 12, 4);
+        std::memcpy(uuid, blob.data() + 16, VK_UUID_SIZE);
+        return header_size >= 16 + VK_UUID_SIZE && header_size <= blob.size()
+            && header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && vendor_id == props.vendorID
+            && device_id == props.deviceID
+            && std::memcmp(uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    // VkPipelineCache persisted under $XDG_CACHE_HOME. The blob is loaded and validated at
+    // construction, written back atomically (tmp file + fsync + rename) at destruction and, if
+    // `autosave` is non-zero, periodically from a background thread.
+    class pipeline_cache {
+    public:
+        pipeline_cache(VkPhysicalDevice physical_device, VkDevice device,
+                       std::chrono::seconds autosave = std::chrono::seconds(30),
+                       std::filesystem::path path = default_cache_path())
+            : device(device), path(std::move(path))
+        {
+            vkGetPhysicalDeviceProperties(physical_device, &props);
+            auto blob = load();
+            warm = !blob.empty();
+            loaded_bytes = blob.size();
+            VkPipelineCacheCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .initialDataSize = blob.size(),
+                .pInitialData = blob.empty() ? nullptr : blob.data(),
+            };
+            if (VK_SUCCESS != vkCreatePipelineCache(device, &info, nullptr, &cache)) {
+                // a driver may still reject a blob that passed our checks; start cold instead
+                info.initialDataSize = 0;
+                info.pInitialData = nullptr;
+                warm = false;
+                if (VK_SUCCESS != vkCreatePipelineCache(device, &info, nullptr, &cache)) {
+                    throw std::runtime_error("vkCreatePipelineCache failed...");
+                }
+            }
+            if (autosave.count() > 0) {
+                saver = std::jthread([this, autosave](std::stop_token stop) {
+                    std::mutex mutex;
+                    std::unique_lock lock(mutex);
+                    while (!wakeup.wait_for(lock, stop, autosave, [&] { return stop.stop_requested(); })) {
+                        if (dirty.exchange(false)) save();
+                    }
+                });
+            }
+        }
+        pipeline_cache(pipeline_cache const&) = delete;
+        pipeline_cache& operator=(pipeline_cache const&) = delete;
+        ~pipeline_cache() {
+            saver = { };
+            save();
+            vkDestroyPipelineCache(device, cache, nullptr);
+        }
+
+        VkPipelineCache get() const noexcept { return cache; }
+
+        VkPipeline create(VkComputePipelineCreateInfo const& info) {
+            VkPipeline pipeline = nullptr;
+            auto t0 = std::chrono::steady_clock::now();
+            if (VK_SUCCESS != vkCreateComputePipelines(device, cache, 1, &info, nullptr, &pipeline)) {
+                std::cerr << "vkCreateComputePipelines failed..." << std::endl;
+            }
+            account(std::chrono::steady_clock::now() - t0);
+            return pipeline;
+        }
+        VkPipeline create(VkGraphicsPipelineCreateInfo const& info) {
+            VkPipeline pipeline = nullptr;
+            auto t0 = std::chrono::steady_clock::now();
+            if (VK_SUCCESS != vkCreateGraphicsPipelines(device, cache, 1, &info, nullptr, &pipeline)) {
+                std::cerr << "vkCreateGraphicsPipelines failed..." << std::endl;
+            }
+            account(std::chrono::steady_clock::now() - t0);
+            return pipeline;
+        }
+
+        bool save() noexcept {
+            std::lock_guard lock(save_mutex);
+            size_t size = 0;
+            if (VK_SUCCESS != vkGetPipelineCacheData(device, cache, &size, nullptr) || size == 0) return false;
+            std::vector<char> blob(size);
+            if (VK_SUCCESS != vkGetPipelineCacheData(device, cache, &size, blob.data())) return false;
+            blob.resize(size);
+
+            cache_file_header header = {
+                .magic = { },
+                .driver_version = props.driverVersion,
+                .data_size = blob.size(),
+                .checksum = fnv1a(blob.data(), blob.size()),
+            };
+            std::memcpy(header.magic, cache_file_magic, sizeof (header.magic));
+
+            std::error_code ec;
+            std::filesystem::create_directories(path.parent_path(), ec);
+            auto tmp = path;
+            tmp += ".tmp." + std::to_string(::getpid());
+            int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) return false;
+            bool ok = write_all(fd, &header, sizeof (header)) && write_all(fd, blob.data(), blob.size()) && ::fsync(fd) == 0;
+            ok = (::close(fd) == 0) && ok;
+            if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+                ::unlink(tmp.c_str());
+                return false;
+            }
+            saved_bytes = blob.size();
+            return true;
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, pipeline_cache const& cache) noexcept {
+            using ms = std::chrono::duration<double, std::milli>;
+            std::lock_guard lock(cache.stats_mutex);
+            return output << "(pipeline-cache" << std::endl
+                          << " (path " << cache.path << ")" << std::endl
+                          << " (start " << (cache.warm ? "warm" : "cold") << ")" << std::endl
+                          << " (loaded-bytes " << cache.loaded_bytes << ")" << std::endl
+                          << " (saved-bytes " << cache.saved_bytes << ")" << std::endl
+                          << " (pipelines " << cache.pipelines << ")" << std::endl
+                          << " (create-ms " << ms(cache.create_time).count() << "))";
+        }
+
+    private:
+        std::vector<char> load() const {
+            std::ifstream input(path, std::ios::binary);
+            cache_file_header header;
+            if (!input.read(reinterpret_cast<char*>(&header), sizeof (header))) return { };
+            if (std::memcmp(header.magic, cache_file_magic, sizeof (header.magic)) != 0 ||
+                header.driver_version != props.driverVersion ||
+                header.data_size > (uint64_t(256) << 20))
+            {
+                return { };
+            }
+            std::vector<char> blob(header.data_size);
+            if (!input.read(blob.data(), blob.size())) return { };
+            if (fnv1a(blob.data(), blob.size()) != header.checksum || !valid_cache_blob(blob, props)) return { };
+            return blob;
+        }
+
+        static bool write_all(int fd, void const* data, size_t size) noexcept {
+            for (auto p = static_cast<char const*>(data); size > 0; ) {
+                auto n = ::write(fd, p, size);
+                if (n < 0) return false;
+                p += n;
+                size -= n;
+            }
+            return true;
+        }
+
+        void account(std::chrono::steady_clock::duration elapsed) {
+            std::lock_guard lock(stats_mutex);
+            pipelines += 1;
+            create_time += elapsed;
+            dirty = true;
+        }
+
+        VkDevice device;
+        std::filesystem::path path;
+        VkPhysicalDeviceProperties props;
+        VkPipelineCache cache = nullptr;
+        bool warm = false;
+        size_t loaded_bytes = 0;
+        std::atomic<size_t> saved_bytes = 0;
+        size_t pipelines = 0;
+        std::chrono::steady_clock::duration create_time = { };
+        std::atomic<bool> dirty = false;
+        mutable std::mutex stats_mutex;
+        std::mutex save_mutex;
+        std::condition_variable_any wakeup;
+        std::jthread saver;
+    };
+} // ::pipeline
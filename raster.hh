@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RASTER_AVX2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RASTER_NEON 1
+#endif
+
+inline namespace raster
+{
+    // Pixels are 32-bit premultiplied ARGB, i.e. wl_shm ARGB8888/XRGB8888 on little endian.
+    struct rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+    struct pixel_view {
+        uint32_t* pixels;
+        int32_t width;
+        int32_t height;
+        int32_t stride;     // in pixels
+    };
+
+    inline rect intersect(rect a, rect b) noexcept {
+        auto const x0 = std::max(a.x, b.x);
+        auto const y0 = std::max(a.y, b.y);
+        auto const x1 = std::min(a.x + a.width, b.x + b.width);
+        auto const y1 = std::min(a.y + a.height, b.y + b.height);
+        return { x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0) };
+    }
+
+    // One row at a time; every set has the same three entry points so callers pick a set once.
+    struct kernels {
+        char const* name;
+        void (*fill)(uint32_t* dst, size_t count, uint32_t color);
+        void (*copy)(uint32_t* dst, uint32_t const* src, size_t count);
+        void (*blend)(uint32_t* dst, uint32_t const* src, size_t count);     // src over dst
+    };
+
+    namespace scalar
+    {
+        inline uint32_t over(uint32_t dst, uint32_t src) noexcept {
+            uint32_t const inv = 255 - (src >> 24);
+            uint32_t rb = (dst & 0x00ff00ff) * inv + 0x00800080;
+            uint32_t ag = ((dst >> 8) & 0x00ff00ff) * inv + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+            return src + (rb | ag);
+        }
+        inline void fill(uint32_t* dst, size_t count, uint32_t color) noexcept {
+            for (size_t i = 0; i < count; ++i) dst[i] = color;
+        }
+        inline void copy(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            for (size_t i = 0; i < count; ++i) dst[i] = src[i];
+        }
+        inline void blend(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            for (size_t i = 0; i < count; ++i) dst[i] = over(dst[i], src[i]);
+        }
+    } // ::scalar
+    inline constexpr kernels scalar_kernels = { "scalar", scalar::fill, scalar::copy, scalar::blend };
+
+#if defined(RASTER_AVX2)
+    namespace avx2
+    {
+        // (x + 128) / 255 rounded, for 16-bit lanes holding a product of two bytes
+        __attribute__((target("avx2"))) inline __m256i div255(__m256i x) noexcept {
+            x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+            return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+        }
+        __attribute__((target("avx2"))) inline void fill(uint32_t* dst, size_t count, uint32_t color) noexcept {
+            auto const c = _mm256_set1_epi32(static_cast<int>(color));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), c);
+            scalar::fill(dst + i, count - i, color);
+        }
+        __attribute__((target("avx2"))) inline void copy(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                    _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i)));
+            }
+            scalar::copy(dst + i, src + i, count - i);
+        }
+        __attribute__((target("avx2"))) inline void blend(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            auto const zero = _mm256_setzero_si256();
+            auto const alpha = _mm256_set_epi8(15, 15, 15, 15, 11, 11, 11, 11, 7, 7, 7, 7, 3, 3, 3, 3,
+                                               15, 15, 15, 15, 11, 11, 11, 11, 7, 7, 7, 7, 3, 3, 3, 3);
+            auto const ones = _mm256_set1_epi8(-1);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                auto const s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+                auto const d = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst + i));
+                auto const inv = _mm256_xor_si256(_mm256_shuffle_epi8(s, alpha), ones);     // 255 - a, per byte
+                auto const lo = div255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(inv, zero)));
+                auto const hi = div255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(inv, zero)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+            }
+            scalar::blend(dst + i, src + i, count - i);
+        }
+    } // ::avx2
+    inline constexpr kernels avx2_kernels = { "avx2", avx2::fill, avx2::copy, avx2::blend };
+#endif
+
+#if defined(RASTER_NEON)
+    namespace neon
+    {
+        inline void fill(uint32_t* dst, size_t count, uint32_t color) noexcept {
+            auto const c = vdupq_n_u32(color);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) vst1q_u32(dst + i, c);
+            scalar::fill(dst + i, count - i, color);
+        }
+        inline void copy(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) vst1q_u32(dst + i, vld1q_u32(src + i));
+            scalar::copy(dst + i, src + i, count - i);
+        }
+        inline void blend(uint32_t* dst, uint32_t const* src, size_t count) noexcept {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                auto const s = vld1q_u32(src + i);
+                auto const d = vreinterpretq_u8_u32(vld1q_u32(dst + i));
+                auto const inv = vreinterpretq_u8_u32(vmulq_n_u32(vsubq_u32(vdupq_n_u32(255), vshrq_n_u32(s, 24)), 0x01010101));
+                auto const lo = vmull_u8(vget_low_u8(d), vget_low_u8(inv));
+                auto const hi = vmull_u8(vget_high_u8(d), vget_high_u8(inv));
+                // rounded x / 255: (x + 128 + ((x + 128) >> 8)) >> 8
+                auto const scaled = vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+                vst1q_u32(dst + i, vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(s), scaled)));
+            }
+            scalar::blend(dst + i, src + i, count - i);
+        }
+    } // ::neon
+    inline constexpr kernels neon_kernels = { "neon", neon::fill, neon::copy, neon::blend };
+#endif
+
+    // The widest set this CPU runs, decided once.
+    inline kernels const& best_kernels() noexcept {
+#if defined(RASTER_AVX2)
+        static kernels const& best = __builtin_cpu_supports("avx2") ? avx2_kernels : scalar_kernels;
+        return best;
+#elif defined(RASTER_NEON)
+        return neon_kernels;
+#else
+        return scalar_kernels;
+#endif
+    }
+
+    inline void fill(kernels const& k, pixel_view target, rect area, uint32_t color) noexcept {
+        area = intersect(area, { 0, 0, target.width, target.height });
+        for (int32_t y = area.y; y < area.y + area.height; ++y) {
+            k.fill(target.pixels + size_t(y) * target.stride + area.x, area.width, color);
+        }
+    }
+    // Copies (`blend` false) or composites (`blend` true) all of `source` with its origin at (x, y).
+    inline void blit(kernels const& k, pixel_view target, pixel_view source, int32_t x, int32_t y, bool blend = false) noexcept {
+        auto const area = intersect({ x, y, source.width, source.height }, { 0, 0, target.width, target.height });
+        auto const row = blend ? k.blend : k.copy;
+        for (int32_t v = area.y; v < area.y + area.height; ++v) {
+            row(target.pixels + size_t(v) * target.stride + area.x,
+                source.pixels + size_t(v - y) * source.stride + (area.x - x),
+                area.width);
+        }
+    }
+} // ::raster
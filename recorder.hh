@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+inline namespace recording
+{
+    // Fork-join pool for one frame's recording jobs. run() deals the job indices out in contiguous
+    // chunks, one deque per thread; a thread takes from the front of its own deque and, once that
+    // is empty, steals from the back of the others', so uneven jobs still finish together. The
+    // calling thread is worker 0 and works too; workers park on an atomic between runs.
+    class job_pool {
+    public:
+        explicit job_pool(size_t threads) : queues(std::max<size_t>(threads, 1)) {
+            for (size_t i = 1; i < queues.size(); ++i) {
+                workers.emplace_back([this, i](std::stop_token stop) { work(i, stop); });
+            }
+        }
+        job_pool(job_pool const&) = delete;
+        job_pool& operator=(job_pool const&) = delete;
+        ~job_pool() {
+            for (auto& worker : workers) worker.request_stop();
+            generation.fetch_add(1, std::memory_order_release);
+            generation.notify_all();
+        }
+
+        size_t size() const noexcept { return queues.size(); }
+        uint64_t steals() const noexcept { return stolen.load(std::memory_order_relaxed); }
+
+        // Calls f(worker, job) for every job in [0, count) and returns when all have returned.
+        // Jobs must not throw; each worker index is only ever used by one thread at a time.
+        template <class F>
+        void run(size_t count, F&& f) {
+            if (count == 0) return;
+            task = [](void* context, size_t worker, size_t job) { (*static_cast<F*>(context))(worker, job); };
+            context = &f;
+            remaining.store(count, std::memory_order_relaxed);
+            auto const n = queues.size();
+            for (size_t w = 0; w < n; ++w) {
+                std::lock_guard lock(queues[w].mutex);
+                for (auto job = count * w / n; job < count * (w + 1) / n; ++job) {
+                    queues[w].jobs.push_back(static_cast<uint32_t>(job));
+                }
+            }
+            generation.fetch_add(1, std::memory_order_release);
+            generation.notify_all();
+            drain(0);
+            for (auto left = remaining.load(std::memory_order_acquire); left != 0; left = remaining.load(std::memory_order_acquire)) {
+                remaining.wait(left, std::memory_order_acquire);
+            }
+        }
+
+    private:
+        struct alignas(64) queue {
+            std::mutex mutex;
+            std::deque<uint32_t> jobs;
+        };
+
+        bool pop(size_t self, uint32_t& job) {
+            {
+                std::lock_guard lock(queues[self].mutex);
+                if (!queues[self].jobs.empty()) {
+                    job = queues[self].jobs.front();
+                    queues[self].jobs.pop_front();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues.size(); ++i) {
+                auto& victim = queues[(self + i) % queues.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.jobs.empty()) {
+                    job = victim.jobs.back();
+                    victim.jobs.pop_back();
+                    stolen.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void drain(size_t self) {
+            for (uint32_t job; pop(self, job); ) {
+                task(context, self, job);
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) remaining.notify_all();
+            }
+        }
+
+        void work(size_t self, std::stop_token stop) noexcept {
+            for (uint64_t seen = 0; ; ) {
+                generation.wait(seen, std::memory_order_acquire);
+                if (stop.stop_requested()) return;
+                seen = generation.load(std::memory_order_acquire);
+                drain(self);
+            }
+        }
+
+        std::vector<queue> queues;
+        void (*task)(void*, size_t, size_t) = nullptr;     // set before the jobs are published
+        void* context = nullptr;
+        alignas(64) std::atomic<size_t> remaining = 0;
+        alignas(64) std::atomic<uint64_t> generation = 0;
+        std::atomic<uint64_t> stolen = 0;
+        std::vector<std::jthread> workers;                  // last: joined before the rest goes
+    };
+
+    // Records one frame as secondary command buffers on a job_pool. Every worker owns a
+    // VkCommandPool per frame in flight, so no pool is ever touched by two threads; begin_frame()
+    // resets the slot's pools in bulk once its fence has signaled, and the secondaries they handed
+    // out are reused from there. record() returns them in job order, whichever thread recorded
+    // which job, so vkCmdExecuteCommands replays the same sequence every time.
+    class parallel_recorder {
+    public:
+        parallel_recorder(VkDevice device, uint32_t queue_family, size_t slots, size_t threads)
+            : device(device), jobs(threads), pools(slots * jobs.size())
+        {
+            for (auto& pool : pools) {
+                VkCommandPoolCreateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = queue_family,
+                };
+                if (VK_SUCCESS != vkCreateCommandPool(device, &info, nullptr, &pool.pool)) {
+                    release();
+                    throw std::runtime_error("vkCreateCommandPool failed...");
+                }
+            }
+        }
+        parallel_recorder(parallel_recorder const&) = delete;
+        parallel_recorder& operator=(parallel_recorder const&) = delete;
+        ~parallel_recorder() { release(); }
+
+        size_t threads() const noexcept { return jobs.size(); }
+
+        // After the slot's fence wait: everything recorded into it last time round is done.
+        void begin_frame(size_t slot) {
+            current = slot;
+            for (size_t w = 0; w < jobs.size(); ++w) {
+                auto& pool = pools[slot * jobs.size() + w];
+                vkResetCommandPool(device, pool.pool, 0);
+                pool.used = 0;
+            }
+        }
+
+        // Records `count` secondaries, f(cmd, job) for each, continuing the render pass in
+        // `inheritance` if it names one. A job whose buffer could not be allocated is dropped.
+        template <class F>
+        std::span<VkCommandBuffer const> record(VkCommandBufferInheritanceInfo const& inheritance, size_t count, F&& f) {
+            recorded.assign(count, nullptr);
+            jobs.run(count, [&](size_t worker, size_t job) {
+                auto cmd = next_buffer(pools[current * jobs.size() + worker]);
+                if (cmd == nullptr) return;
+                VkCommandBufferBeginInfo begin = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+                           | (inheritance.renderPass ? VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT : 0u),
+                    .pInheritanceInfo = &inheritance,
+                };
+                vkBeginCommandBuffer(cmd, &begin);
+                f(cmd, job);
+                vkEndCommandBuffer(cmd);
+                recorded[job] = cmd;
+            });
+            auto const end = std::remove(recorded.begin(), recorded.end(), nullptr);
+            dropped += recorded.end() - end;
+            recorded.erase(end, recorded.end());
+            total += recorded.size();
+            return recorded;
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, parallel_recorder const& r) noexcept {
+            size_t allocated = 0;
+            for (auto const& pool : r.pools) allocated += pool.buffers.size();
+            return output << "(parallel-recorder"
+                          << " (threads " << r.threads() << ")"
+                          << " (secondaries " << r.total << ")"
+                          << " (allocated " << allocated << ")"
+                          << " (steals " << r.jobs.steals() << ")"
+                          << " (dropped " << r.dropped << "))";
+        }
+
+    private:
+        // one per (slot, worker); only that worker touches it while a frame records
+        struct alignas(64) worker_pool {
+            VkCommandPool pool = nullptr;
+            std::vector<VkCommandBuffer> buffers;
+            size_t used = 0;
+        };
+
+        VkCommandBuffer next_buffer(worker_pool& pool) noexcept {
+            if (pool.used == pool.buffers.size()) {
+                constexpr uint32_t grow = 16;
+                VkCommandBufferAllocateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .pNext = nullptr,
+                    .commandPool = pool.pool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                    .commandBufferCount = grow,
+                };
+                pool.buffers.resize(pool.used + grow);
+                if (VK_SUCCESS != vkAllocateCommandBuffers(device, &info, pool.buffers.data() + pool.used)) {
+                    pool.buffers.resize(pool.used);
+                    return nullptr;
+                }
+            }
+            return pool.buffers[pool.used++];
+        }
+
+        void release() noexcept {
+            for (auto& pool : pools) {
+                if (pool.pool) vkDestroyCommandPool(device, pool.pool, nullptr);
+                pool = { };
+            }
+        }
+
+        VkDevice device;
+        job_pool jobs;
+        std::vector<worker_pool> pools;         // [slot * threads + worker]
+        std::vector<VkCommandBuffer> recorded;
+        size_t current = 0;
+        uint64_t total = 0;
+        uint64_t dropped = 0;
+    };
+} // ::recording
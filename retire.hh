@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+inline namespace lifetime
+{
+    // The vkDestroy* of a device-level handle type, keyed by the handle's pointee (VkFence_T for
+    // VkFence); specialized once per type with INTERN_VK_DESTROY.
+    template <class T> struct vk_destroy;
+#define INTERN_VK_DESTROY(vk_handle, vk_destroy_function)                       \
+    template <> struct vk_destroy<vk_handle##_T> {                              \
+        static void call(VkDevice device, void* handle) noexcept {              \
+            vk_destroy_function(device, static_cast<vk_handle>(handle), nullptr); \
+        }                                                                       \
+    };
+
+    // Deferred destruction for everything the render loop creates. Every submission to the
+    // render queue takes a serial from submitted(); a handle that goes away is not destroyed but
+    // parked in a batch tagged with the latest serial, as no later submission can reference it.
+    // Once the caller has seen the fence of submission `s` signaled, collect(s) destroys every
+    // batch tagged s or earlier wholesale: a fence covers everything submitted before it on its
+    // queue, whichever window or frame slot that was. Swapchain recreation and other churn thus
+    // never need vkDeviceWaitIdle.
+    //
+    // There is one installed queue per process, which is what keeps retire<T> stateless and the
+    // handles pointer-sized. Destroying the queue idles the device and drains every batch.
+    class retire_queue {
+    public:
+        using destroy_function = void (*)(VkDevice, void*) noexcept;
+
+        explicit retire_queue(VkDevice device) : device(device) {
+            retire_queue* expected = nullptr;
+            if (!installed.compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+                throw std::runtime_error("a retire_queue is already installed...");
+            }
+        }
+        retire_queue(retire_queue const&) = delete;
+        retire_queue& operator=(retire_queue const&) = delete;
+        ~retire_queue() {
+            drain();
+            installed.store(nullptr, std::memory_order_release);
+        }
+
+        static retire_queue* active() noexcept { return installed.load(std::memory_order_acquire); }
+
+        // Right before a vkQueueSubmit; the serial goes with that submission's fence.
+        uint64_t submitted() noexcept {
+            std::lock_guard lock(mutex);
+            return ++serial;
+        }
+
+        void push(destroy_function destroy, void* handle) {
+            std::lock_guard lock(mutex);
+            if (batches.empty() || batches.back().serial != serial) batches.push_back({ serial, { } });
+            batches.back().entries.push_back({ destroy, handle });
+            ++retired;
+        }
+
+        // `completed`: the serial of a submission whose fence has signaled.
+        void collect(uint64_t completed) {
+            std::vector<entry> ready;
+            {
+                std::lock_guard lock(mutex);
+                while (!batches.empty() && batches.front().serial <= completed) {
+                    auto& entries = batches.front().entries;
+                    ready.insert(ready.end(), entries.begin(), entries.end());
+                    batches.pop_front();
+                }
+            }
+            destroy(ready);
+        }
+
+        // Idles the device and destroys everything retired so far, for teardown that must happen
+        // in order (a swapchain before its VkSurfaceKHR).
+        void drain() {
+            vkDeviceWaitIdle(device);
+            collect(UINT64_MAX);
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, retire_queue const& queue) noexcept {
+            std::lock_guard lock(queue.mutex);
+            size_t pending = 0;
+            for (auto const& batch : queue.batches) pending += batch.entries.size();
+            return output << "(retire-queue"
+                          << " (submissions " << queue.serial << ")"
+                          << " (retired " << queue.retired << ")"
+                          << " (destroyed " << queue.destroyed << ")"
+                          << " (batches " << queue.flushes << ")"
+                          << " (max-batch " << queue.max_batch << ")"
+                          << " (pending " << pending << "))";
+        }
+
+    private:
+        struct entry {
+            destroy_function destroy;
+            void* handle;
+        };
+        struct tagged_batch {
+            uint64_t serial;                        // latest submission when retired
+            std::vector<entry> entries;
+        };
+
+        void destroy(std::vector<entry>& batch) noexcept {
+            if (batch.empty()) return;
+            for (auto const& e : batch) e.destroy(device, e.handle);
+            std::lock_guard lock(mutex);
+            destroyed += batch.size();
+            max_batch = std::max(max_batch, batch.size());
+            ++flushes;
+            batch.clear();
+        }
+
+        inline static std::atomic<retire_queue*> installed = nullptr;
+        VkDevice device;
+        mutable std::mutex mutex;
+        std::deque<tagged_batch> batches;           // oldest first
+        uint64_t serial = 0;
+        uint64_t retired = 0;
+        uint64_t destroyed = 0;
+        uint64_t flushes = 0;
+        size_t max_batch = 0;
+    };
+
+    // Stateless deleter: hands the handle to the installed retire_queue. With none installed the
+    // handle is leaked (and reported) rather than destroyed under a frame that may still use it.
+    template <class T>
+    struct retire {
+        void operator()(T* handle) const noexcept {
+            if (auto queue = retire_queue::active()) queue->push(vk_destroy<T>::call, handle);
+            else std::cerr << "no retire_queue, leaking a vulkan handle..." << std::endl;
+        }
+    };
+    template <class T> using vk_ptr = std::unique_ptr<T, retire<T>>;
+} // ::lifetime
@@ -0,0 +1,25 @@
+#version 450
+
+// One object per instance: firstInstance of each indirect (or direct) draw is the object index.
+
+struct Object {
+    vec4 sphere;        // xyz center, w radius
+    vec4 color;
+    uint mesh;
+    uint pad0, pad1, pad2;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects { Object objects[]; };
+
+layout(push_constant) uniform Params {
+    mat4 view_proj;
+} params;
+
+layout(location = 0) in vec3 position;     // unit mesh, inside the unit sphere
+layout(location = 0) out vec4 color;
+
+void main() {
+    vec4 sphere = objects[gl_InstanceIndex].sphere;
+    gl_Position = params.view_proj * vec4(sphere.xyz + position * sphere.w, 1.0);
+    color = objects[gl_InstanceIndex].color;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <semaphore>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#include "raster.hh"
+
+inline namespace software
+{
+    // The software counterpart of a VkSwapchainKHR: a few XRGB8888 wl_buffers carved out of one
+    // memfd that is mapped once. A buffer is handed out again only after the compositor sent
+    // wl_buffer.release for it (on the event thread). A resize builds a new pool and retires the
+    // old one, which is unmapped once none of its buffers is still held by the compositor.
+    class shm_swapchain {
+    public:
+        struct buffer {
+            shm_swapchain* owner;
+            wl_buffer* proxy;
+            uint32_t* pixels;
+            std::atomic<bool> busy = false;
+        };
+
+        shm_swapchain(wl_shm* shm, int32_t width, int32_t height, size_t count = 3)
+            : shm(shm), count(count)
+        {
+            current = create_pool(width, height);
+        }
+        shm_swapchain(shm_swapchain const&) = delete;
+        shm_swapchain& operator=(shm_swapchain const&) = delete;
+        ~shm_swapchain() {
+            for (auto& p : retired) destroy_pool(*p);
+            destroy_pool(*current);
+        }
+
+        int32_t width() const noexcept { return current->width; }
+        int32_t height() const noexcept { return current->height; }
+
+        void resize(int32_t width, int32_t height) {
+            if (width == current->width && height == current->height) return;
+            retired.push_back(std::move(current));
+            current = create_pool(width, height);
+        }
+
+        // A released buffer of the current size, or null if none came back within `timeout`.
+        buffer* acquire(std::chrono::milliseconds timeout) {
+            while (released.try_acquire()) continue;
+            reap();
+            for (;;) {
+                for (auto& b : current->buffers) {
+                    if (!b->busy.load(std::memory_order_acquire)) return b.get();
+                }
+                ++waits;
+                if (!released.try_acquire_for(timeout)) return nullptr;
+            }
+        }
+        pixel_view view(buffer const& b) const noexcept {
+            return { b.pixels, current->width, current->height, current->width };
+        }
+        // Attaches and damages `b`; the caller adds its frame callback/feedback and commits.
+        void attach(wl_surface* surface, buffer& b) noexcept {
+            b.busy.store(true, std::memory_order_relaxed);
+            wl_surface_attach(surface, b.proxy, 0, 0);
+            wl_surface_damage_buffer(surface, 0, 0, current->width, current->height);
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, shm_swapchain const& chain) noexcept {
+            return output << "(shm-swapchain"
+                          << " (buffers " << chain.count << ")"
+                          << " (pools " << chain.pools << ")"
+                          << " (buffer-waits " << chain.waits << "))";
+        }
+
+    private:
+        struct pool {
+            int fd = -1;
+            void* mapping = MAP_FAILED;
+            size_t size = 0;
+            wl_shm_pool* proxy = nullptr;
+            int32_t width = 0;
+            int32_t height = 0;
+            std::vector<std::unique_ptr<buffer>> buffers;
+        };
+
+        std::unique_ptr<pool> create_pool(int32_t width, int32_t height) {
+            auto p = std::make_unique<pool>();
+            p->width = width;
+            p->height = height;
+            auto const frame_size = size_t(width) * height * 4;
+            p->size = frame_size * count;
+            p->fd = ::memfd_create("wayland-vulkan-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (p->fd < 0 || ::ftruncate(p->fd, p->size) != 0) {
+                destroy_pool(*p);
+                throw std::runtime_error("memfd_create failed...");
+            }
+            ::fcntl(p->fd, F_ADD_SEALS, F_SEAL_SHRINK);
+            p->mapping = ::mmap(nullptr, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+            if (p->mapping == MAP_FAILED) {
+                destroy_pool(*p);
+                throw std::runtime_error("mmap failed...");
+            }
+            p->proxy = wl_shm_create_pool(shm, p->fd, static_cast<int32_t>(p->size));
+            for (size_t i = 0; i < count; ++i) {
+                auto proxy = wl_shm_pool_create_buffer(p->proxy, static_cast<int32_t>(frame_size * i),
+                                                       width, height, width * 4, WL_SHM_FORMAT_XRGB8888);
+                auto pixels = reinterpret_cast<uint32_t*>(static_cast<char*>(p->mapping) + frame_size * i);
+                auto& b = *p->buffers.emplace_back(new buffer{ this, proxy, pixels });
+                wl_buffer_add_listener(proxy, &buffer_listener, &b);
+            }
+            ++pools;
+            return p;
+        }
+        void destroy_pool(pool& p) noexcept {
+            for (auto& b : p.buffers) wl_buffer_destroy(b->proxy);
+            if (p.proxy) wl_shm_pool_destroy(p.proxy);
+            if (p.mapping != MAP_FAILED) ::munmap(p.mapping, p.size);
+            if (p.fd >= 0) ::close(p.fd);
+        }
+        void reap() noexcept {
+            while (!retired.empty()) {
+                auto& p = *retired.front();
+                if (std::any_of(p.buffers.begin(), p.buffers.end(), [](auto const& b) { return b->busy.load(); })) break;
+                destroy_pool(p);
+                retired.pop_front();
+            }
+        }
+
+        wl_shm* shm;
+        size_t count;
+        std::unique_ptr<pool> current;
+        std::deque<std::unique_ptr<pool>> retired;
+        std::counting_semaphore<1 << 16> released{ 0 };
+        uint64_t pools = 0;
+        uint64_t waits = 0;
+
+        static inline wl_buffer_listener const buffer_listener = {
+            .release = [](auto data, auto) noexcept {
+                auto b = static_cast<buffer*>(data);
+                b->busy.store(false, std::memory_order_release);
+                b->owner->released.release();
+            },
+        };
+    };
+} // ::software
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <type_traits>
+
+inline namespace concurrent
+{
+    // Bounded single-producer/single-consumer ring. Each side owns one index; the producer keeps a
+    // cached copy of the consumer's so it only touches that cache line when the ring looks full,
+    // and the consumer takes everything published in one acquire load. No allocation after
+    // construction.
+    template <class T, size_t N>
+        requires (std::is_trivially_copyable_v<T> && N >= 2 && (N & (N - 1)) == 0)
+    class spsc_ring {
+    public:
+        static constexpr size_t capacity = N;
+
+        // producer side
+        bool push(T const& item) noexcept {
+            auto const pos = head.load(std::memory_order_relaxed);
+            if (pos - cached_tail == N) {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (pos - cached_tail == N) return false;
+            }
+            slots[pos & (N - 1)] = item;
+            head.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side: hands every item published so far to `f`, oldest first
+        template <class F>
+        size_t drain(F&& f) noexcept(std::is_nothrow_invocable_v<F, T const&>) {
+            auto pos = tail.load(std::memory_order_relaxed);
+            auto const end = head.load(std::memory_order_acquire);
+            auto const count = end - pos;
+            for (; pos != end; ++pos) {
+                f(slots[pos & (N - 1)]);
+            }
+            tail.store(pos, std::memory_order_release);
+            return count;
+        }
+
+        size_t size_approx() const noexcept {
+            return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr size_t line = 64;
+
+        alignas(line) std::atomic<size_t> head = 0;     // written by the producer
+        size_t cached_tail = 0;                         // producer's view of tail
+        alignas(line) std::atomic<size_t> tail = 0;     // written by the consumer
+        alignas(line) std::array<T, N> slots;
+    };
+
+    // Single-slot handoff of the most recent value (a triple buffer): publish() never waits for
+    // the consumer and take() never waits for the producer; intermediate values are superseded.
+    template <class T>
+        requires std::is_trivially_copyable_v<T>
+    class latest_value {
+    public:
+        // producer side
+        void publish(T const& value) noexcept {
+            slots[back] = value;
+            back = middle.exchange(back | fresh, std::memory_order_acq_rel) & index;
+        }
+
+        // consumer side: the newest value published since the last take(), if any
+        std::optional<T> take() noexcept {
+            if ((middle.load(std::memory_order_relaxed) & fresh) == 0) return std::nullopt;
+            front = middle.exchange(front, std::memory_order_acq_rel) & index;
+            return slots[front];
+        }
+
+    private:
+        static constexpr uint8_t index = 3;
+        static constexpr uint8_t fresh = 4;
+        static constexpr size_t line = 64;
+
+        std::array<T, 3> slots = { };
+        alignas(line) uint8_t back = 0;                 // producer's slot
+        alignas(line) std::atomic<uint8_t> middle = 1;  // last published slot, plus `fresh`
+        alignas(line) uint8_t front = 2;                // consumer's slot
+    };
+} // ::concurrent
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline namespace startup
+{
+    // Wall-clock spans of named startup phases, from whichever thread runs them, relative to
+    // one origin (the start of main). Phases on different threads overlap; the report shows
+    // which thread ran what, and mark() records instants such as the first present.
+    class phase_timer {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        explicit phase_timer(clock::time_point origin = clock::now()) noexcept : origin(origin) { }
+
+        template <class F>
+        decltype (auto) run(char const* name, F&& f) {
+            struct record {
+                phase_timer* timer;
+                char const* name;
+                clock::time_point begin = clock::now();
+                ~record() { timer->push(name, begin, clock::now()); }
+            } r = { this, name };
+            return std::forward<F>(f)();
+        }
+        void mark(char const* name) {
+            auto const now = clock::now();
+            push(name, now, now);
+        }
+        std::chrono::nanoseconds since_origin() const noexcept { return clock::now() - origin; }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, phase_timer const& timer) noexcept {
+            using ms = std::chrono::duration<double, std::milli>;
+            std::lock_guard lock(timer.mutex);
+            auto phases = timer.phases;
+            std::sort(phases.begin(), phases.end(), [](auto const& a, auto const& b) { return a.begin < b.begin; });
+            output << "(startup-phases" << std::endl;
+            for (auto const& [name, thread, begin, end] : phases) {
+                output << " (" << name
+                       << " (thread " << thread << ")"
+                       << " (start-ms " << ms(begin - timer.origin).count() << ")"
+                       << " (ms " << ms(end - begin).count() << "))" << std::endl;
+            }
+            return output << ")";
+        }
+
+    private:
+        struct phase {
+            char const* name;
+            size_t thread;          // 0: the thread that ran main
+            clock::time_point begin;
+            clock::time_point end;
+        };
+
+        void push(char const* name, clock::time_point begin, clock::time_point end) {
+            std::lock_guard lock(mutex);
+            auto const id = std::this_thread::get_id();
+            auto it = std::find(threads.begin(), threads.end(), id);
+            if (it == threads.end()) it = threads.insert(it, id);
+            phases.push_back({ name, static_cast<size_t>(it - threads.begin()), begin, end });
+        }
+
+        clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<std::thread::id> threads = { std::this_thread::get_id() };
+        std::vector<phase> phases;
+    };
+} // ::startup
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sycl/sycl.hpp>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.hh"
+
+inline namespace compute
+{
+    enum class interop_mode { zero_copy, staging };
+    template <class Ch>
+    inline auto& operator<<(std::basic_ostream<Ch>& output, interop_mode mode) noexcept {
+        return output << (mode == interop_mode::zero_copy ? "zero-copy" : "staging");
+    }
+
+    // Animated test pattern, written as R8G8B8A8 to match the swapchain format.
+    inline sycl::event generate_pattern(sycl::queue& queue, uint32_t* pixels, VkExtent2D extent, uint64_t frame) {
+        auto const width = extent.width;
+        auto const t = static_cast<uint32_t>(frame);
+        return queue.parallel_for(sycl::range<2>(extent.height, extent.width), [=](sycl::item<2> item) {
+            auto const y = static_cast<uint32_t>(item[0]);
+            auto const x = static_cast<uint32_t>(item[1]);
+            uint32_t const r = (x + t) & 0xff;
+            uint32_t const g = (y + 2 * t) & 0xff;
+            uint32_t const b = ((x ^ y) + 3 * t) & 0xff;
+            pixels[y * width + x] = r | (g << 8) | (b << 16) | 0xff000000u;
+        });
+    }
+
+    // Runs a SYCL kernel per frame whose output Vulkan copies into the swapchain image.
+    //
+    // zero_copy: the kernel writes host USM that Vulkan imported with VK_EXT_external_memory_host,
+    //   so both APIs see the same pages (the SYCL CPU device and lavapipe both work in host memory).
+    // staging: the kernel writes device USM, then the result is copied into a persistently mapped
+    //   host-visible Vulkan buffer.
+    //
+    // Completion is passed to Vulkan by a host_task that signals the `ready` timeline semaphore,
+    // so the render thread submits right away and the GPU waits. Without timeline semaphores,
+    // produce() blocks until the kernel is done. Each slot belongs to one frame in flight, so its
+    // buffer is free once that frame's fence is signaled.
+    class sycl_stage {
+    public:
+        struct output {
+            VkBuffer buffer;
+            VkSemaphore ready;      // null: already complete
+            uint64_t value;
+        };
+
+        sycl_stage(VkPhysicalDevice physical_device, VkDevice device, device_allocator& allocator,
+                   size_t slots, bool timeline, bool external_memory_host)
+            : device(device),
+              allocator(allocator),
+              queue(sycl::default_selector{}, sycl::property::queue::in_order()),
+              slots(slots)
+        {
+            vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+            if (external_memory_host) {
+                VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_props = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+                    .pNext = nullptr,
+                    .minImportedHostPointerAlignment = 0,
+                };
+                VkPhysicalDeviceProperties2 props = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                    .pNext = &host_props,
+                    .properties = { },
+                };
+                vkGetPhysicalDeviceProperties2(physical_device, &props);
+                import_alignment = host_props.minImportedHostPointerAlignment;
+                host_pointer_properties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+                    vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT"));
+            }
+            current = (import_alignment != 0 && host_pointer_properties) ? interop_mode::zero_copy : interop_mode::staging;
+            if (timeline) {
+                VkSemaphoreTypeCreateInfo type = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                    .pNext = nullptr,
+                    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                    .initialValue = 0,
+                };
+                VkSemaphoreCreateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                    .pNext = &type,
+                    .flags = 0,
+                };
+                if (VK_SUCCESS != vkCreateSemaphore(device, &info, nullptr, &ready)) {
+                    throw std::runtime_error("vkCreateSemaphore (timeline) failed...");
+                }
+            }
+            device_name = queue.get_device().get_info<sycl::info::device::name>();
+        }
+        sycl_stage(sycl_stage const&) = delete;
+        sycl_stage& operator=(sycl_stage const&) = delete;
+        ~sycl_stage() {
+            queue.wait();
+            for (auto& slot : slots) release(slot);
+            if (ready) vkDestroySemaphore(device, ready, nullptr);
+        }
+
+        interop_mode mode() const noexcept { return current; }
+
+        // Starts the kernel for `frame` into `slot`'s buffer. The caller has waited for the last
+        // frame that used this slot, and submits a copy from `buffer` that waits for `value`.
+        output produce(size_t index, VkExtent2D extent, uint64_t frame) {
+            auto t0 = std::chrono::steady_clock::now();
+            auto& slot = slots[index];
+            // slots still holding imported memory after a fallback are rebuilt as they come round
+            if (slot.extent.width != extent.width || slot.extent.height != extent.height ||
+                (current == interop_mode::staging && slot.imported))
+            {
+                release(slot);
+                if (current == interop_mode::zero_copy && !create_zero_copy(slot, extent)) {
+                    std::cerr << "host pointer import failed, falling back to staging" << std::endl;
+                    current = interop_mode::staging;
+                }
+                if (current == interop_mode::staging) create_staging(slot, extent);
+            }
+            auto const size = slot.size;
+            if (current == interop_mode::zero_copy) {
+                generate_pattern(queue, slot.host, extent, frame);
+            }
+            else {
+                generate_pattern(queue, slot.device_pixels, extent, frame);
+                queue.memcpy(slot.staging.mapped, slot.device_pixels, size);
+                copied_bytes += size;
+            }
+            auto const value = ++signaled;
+            auto done = queue.submit([&](sycl::handler& handler) {
+                handler.host_task([this, staging = slot.staging, value] {
+                    if (staging) allocator.flush(staging);
+                    if (ready) {
+                        VkSemaphoreSignalInfo info = {
+                            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+                            .pNext = nullptr,
+                            .semaphore = ready,
+                            .value = value,
+                        };
+                        vkSignalSemaphore(device, &info);
+                    }
+                });
+            });
+            if (!ready) done.wait();
+            frames += 1;
+            produce_time += std::chrono::steady_clock::now() - t0;
+            return { slot.buffer, ready, ready ? value : 0 };
+        }
+
+        // Blocks until every kernel submitted so far has finished (benchmarks only).
+        void wait() { queue.wait(); }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, sycl_stage const& stage) noexcept {
+            using us = std::chrono::duration<double, std::micro>;
+            auto const n = std::max<uint64_t>(stage.frames, 1);
+            return output << "(sycl-stage"
+                          << " (device \"" << stage.device_name << "\")"
+                          << " (mode " << stage.current << ")"
+                          << " (frames " << stage.frames << ")"
+                          << " (produce-avg-us " << us(stage.produce_time).count() / n << ")"
+                          << " (copied-bytes " << stage.copied_bytes << "))";
+        }
+
+    private:
+        struct slot_buffers {
+            VkExtent2D extent = { 0, 0 };
+            VkDeviceSize size = 0;
+            VkBuffer buffer = nullptr;
+            VkDeviceMemory imported = nullptr;      // zero_copy
+            uint32_t* host = nullptr;               // zero_copy: host USM backing `imported`
+            allocation staging;                     // staging: persistently mapped
+            uint32_t* device_pixels = nullptr;      // staging: kernel output
+        };
+
+        VkBuffer create_buffer(VkDeviceSize size, void const* next) {
+            VkBufferCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = next,
+                .flags = 0,
+                .size = size,
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+            };
+            VkBuffer buffer = nullptr;
+            if (VK_SUCCESS != vkCreateBuffer(device, &info, nullptr, &buffer)) {
+                throw std::runtime_error("vkCreateBuffer failed...");
+            }
+            return buffer;
+        }
+
+        // Both fill `slot` as they go and release it when a step fails, so a throw or a fallback
+        // leaves nothing behind.
+        bool create_zero_copy(slot_buffers& slot, VkExtent2D extent) {
+            auto const size = align_up(VkDeviceSize(extent.width) * extent.height * 4, import_alignment);
+            auto host = static_cast<uint32_t*>(sycl::aligned_alloc_host(import_alignment, size, queue));
+            if (!host) return false;
+            slot = { .extent = extent, .size = size, .host = host };
+            try {
+                VkMemoryHostPointerPropertiesEXT pointer_props = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+                    .pNext = nullptr,
+                    .memoryTypeBits = 0,
+                };
+                if (VK_SUCCESS != host_pointer_properties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                                                          host, &pointer_props))
+                {
+                    release(slot);
+                    return false;
+                }
+                VkExternalMemoryBufferCreateInfo external = {
+                    .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+                    .pNext = nullptr,
+                    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                };
+                slot.buffer = create_buffer(size, &external);
+                VkMemoryRequirements requirements;
+                vkGetBufferMemoryRequirements(device, slot.buffer, &requirements);
+
+                // the host writes through its own pointer, so only coherent types avoid flushes we
+                // cannot issue on memory we never mapped
+                uint32_t type = UINT32_MAX;
+                for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+                    auto const bit = 1u << i;
+                    if ((requirements.memoryTypeBits & pointer_props.memoryTypeBits & bit) &&
+                        (memory_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+                    {
+                        type = i;
+                        break;
+                    }
+                }
+                VkImportMemoryHostPointerInfoEXT import = {
+                    .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+                    .pNext = nullptr,
+                    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                    .pHostPointer = host,
+                };
+                VkMemoryAllocateInfo info = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                    .pNext = &import,
+                    .allocationSize = size,
+                    .memoryTypeIndex = type,
+                };
+                VkDeviceMemory memory = nullptr;
+                if (type == UINT32_MAX || VK_SUCCESS != vkAllocateMemory(device, &info, nullptr, &memory)) {
+                    release(slot);
+                    return false;
+                }
+                slot.imported = memory;
+                if (VK_SUCCESS != vkBindBufferMemory(device, slot.buffer, memory, 0)) {
+                    release(slot);
+                    return false;
+                }
+            }
+            catch (...) {
+                release(slot);
+                throw;
+            }
+            return true;
+        }
+
+        void create_staging(slot_buffers& slot, VkExtent2D extent) {
+            auto const size = VkDeviceSize(extent.width) * extent.height * 4;
+            slot = { .extent = extent, .size = size };
+            try {
+                slot.buffer = create_buffer(size, nullptr);
+                slot.staging = allocator.bind(slot.buffer,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+                slot.device_pixels = sycl::malloc_device<uint32_t>(size / 4, queue);
+                if (!slot.device_pixels) throw std::runtime_error("sycl::malloc_device failed...");
+            }
+            catch (...) {
+                release(slot);
+                throw;
+            }
+        }
+
+        void release(slot_buffers& slot) noexcept {
+            if (slot.buffer) vkDestroyBuffer(device, slot.buffer, nullptr);
+            if (slot.imported) vkFreeMemory(device, slot.imported, nullptr);
+            if (slot.host) sycl::free(slot.host, queue);
+            if (slot.staging) allocator.free(slot.staging);
+            if (slot.device_pixels) sycl::free(slot.device_pixels, queue);
+            slot = { };
+        }
+
+        VkDevice device;
+        device_allocator& allocator;
+        VkPhysicalDeviceMemoryProperties memory_properties;
+        sycl::queue queue;
+        std::string device_name;
+        std::vector<slot_buffers> slots;
+        interop_mode current = interop_mode::staging;
+        VkDeviceSize import_alignment = 0;
+        PFN_vkGetMemoryHostPointerPropertiesEXT host_pointer_properties = nullptr;
+        VkSemaphore ready = nullptr;
+        uint64_t signaled = 0;
+        uint64_t frames = 0;
+        uint64_t copied_bytes = 0;
+        std::chrono::steady_clock::duration produce_time = { };
+    };
+} // ::compute
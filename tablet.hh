@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+#include "zwp-tablet-v2-client.h"
+
+#include "spsc_ring.hh"
+
+inline namespace tablet
+{
+    // Raw zwp_tablet_tool_v2 event, reduced to the axes we use. This is also the unit of the
+    // recorded streams (one event per line) that the replay benchmark feeds back in.
+    struct tablet_event {
+        enum kind_type : uint32_t {
+            proximity_in, proximity_out, down, up, motion, pressure, distance, tilt, frame,
+        };
+        kind_type kind;
+        uint32_t time;      // frame: compositor timestamp in ms
+        float a;
+        float b;
+    };
+    inline std::ostream& operator<<(std::ostream& output, tablet_event const& event) {
+        return output << event.kind << ' ' << event.time << ' ' << event.a << ' ' << event.b;
+    }
+    inline std::istream& operator>>(std::istream& input, tablet_event& event) {
+        uint32_t kind = 0;
+        if (input >> kind >> event.time >> event.a >> event.b) {
+            event.kind = static_cast<tablet_event::kind_type>(std::min<uint32_t>(kind, tablet_event::frame));
+        }
+        return input;
+    }
+
+    // Tool state as of one zwp_tablet_tool_v2.frame: all axis events between two frame events
+    // are coalesced into one sample, and every frame produces exactly one sample.
+    struct tablet_sample {
+        enum : uint32_t {
+            in_proximity = 1,
+            touching = 2,
+            proximity_changed = 4,
+            contact_changed = 8,
+        };
+        int64_t received;   // steady_clock ns when the frame event was handled
+        uint32_t time;      // compositor timestamp in ms
+        uint32_t tool;
+        float x;            // surface-local
+        float y;
+        float pressure;     // 0..1
+        float distance;     // 0..1
+        float tilt_x;       // degrees
+        float tilt_y;
+        uint32_t flags;
+    };
+
+    // Producer side runs wherever the Wayland events are dispatched; the render thread calls
+    // drain() once per frame. Samples that do not fit into the ring wait in a fixed backlog (in
+    // order) rather than being dropped. Only if the renderer stalls long enough to fill that too
+    // are consecutive samples merged into the newest backlogged one, keeping its proximity and
+    // contact transitions, so a stroke never loses its down/up.
+    class tablet_input {
+    public:
+        struct tool {
+            tablet_input* input;
+            zwp_tablet_tool_v2* proxy;
+            tablet_sample state;
+        };
+        // Only tools produce samples; tablets and pads are tracked so their proxies (and the
+        // pad's groups) are destroyed on `removed` or at teardown.
+        struct pad {
+            tablet_input* input;
+            zwp_tablet_pad_v2* proxy;
+            std::vector<zwp_tablet_pad_group_v2*> groups;
+        };
+
+        tablet_input() = default;
+        tablet_input(tablet_input const&) = delete;
+        tablet_input& operator=(tablet_input const&) = delete;
+        ~tablet_input() {
+            for (auto& t : tools) {
+                if (t->proxy) zwp_tablet_tool_v2_destroy(t->proxy);
+            }
+            for (auto& p : pads) {
+                if (p->proxy) remove_pad(*p);
+            }
+            for (auto proxy : tablets) zwp_tablet_v2_destroy(proxy);
+        }
+
+        // producer side
+        tool& add_tool(zwp_tablet_tool_v2* proxy) {
+            auto id = static_cast<uint32_t>(tools.size());
+            return *tools.emplace_back(new tool{ this, proxy, { .tool = id } });
+        }
+        void remove_tool(tool& t) noexcept {
+            zwp_tablet_tool_v2_destroy(t.proxy);
+            t.proxy = nullptr;
+        }
+        void add_tablet(zwp_tablet_v2* proxy) {
+            tablets.push_back(proxy);
+        }
+        void remove_tablet(zwp_tablet_v2* proxy) noexcept {
+            tablets.erase(std::remove(tablets.begin(), tablets.end(), proxy), tablets.end());
+            zwp_tablet_v2_destroy(proxy);
+        }
+        pad& add_pad(zwp_tablet_pad_v2* proxy) {
+            return *pads.emplace_back(new pad{ this, proxy, {} });
+        }
+        void remove_pad(pad& p) noexcept {
+            for (auto group : p.groups) zwp_tablet_pad_group_v2_destroy(group);
+            p.groups.clear();
+            zwp_tablet_pad_v2_destroy(p.proxy);
+            p.proxy = nullptr;
+        }
+        void handle(tool& t, tablet_event const& event) noexcept {
+            events.fetch_add(1, std::memory_order_relaxed);
+            if (record) *record << event << '\n';
+            auto& s = t.state;
+            switch (event.kind) {
+            case tablet_event::proximity_in:
+                s.flags |= tablet_sample::in_proximity | tablet_sample::proximity_changed;
+                break;
+            case tablet_event::proximity_out:
+                s.flags &= ~(tablet_sample::in_proximity | tablet_sample::touching);
+                s.flags |= tablet_sample::proximity_changed;
+                break;
+            case tablet_event::down:
+                s.flags |= tablet_sample::touching | tablet_sample::contact_changed;
+                break;
+            case tablet_event::up:
+                s.flags &= ~tablet_sample::touching;
+                s.flags |= tablet_sample::contact_changed;
+                break;
+            case tablet_event::motion:   s.x = event.a; s.y = event.b; break;
+            case tablet_event::pressure: s.pressure = event.a; break;
+            case tablet_event::distance: s.distance = event.a; break;
+            case tablet_event::tilt:     s.tilt_x = event.a; s.tilt_y = event.b; break;
+            case tablet_event::frame:
+                s.time = event.time;
+                s.received = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+                publish(s);
+                s.flags &= ~(tablet_sample::proximity_changed | tablet_sample::contact_changed);
+                break;
+            }
+        }
+        // Moves backlogged samples into the ring once the consumer made room.
+        void flush() noexcept {
+            size_t i = 0;
+            while (i < backlog_size && ring.push(backlog[i])) ++i;
+            if (i == 0) return;
+            std::copy(backlog.begin() + i, backlog.begin() + backlog_size, backlog.begin());
+            backlog_size -= i;
+        }
+        size_t backlogged_now() const noexcept { return backlog_size; }
+
+        // consumer side
+        template <class F>
+        size_t drain(F&& f) {
+            return ring.drain(std::forward<F>(f));
+        }
+
+        std::ostream* record = nullptr;
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, tablet_input const& input) noexcept {
+            return output << "(tablet-stats"
+                          << " (tools " << input.tools.size() << ")"
+                          << " (events " << input.events.load() << ")"
+                          << " (samples " << input.samples.load() << ")"
+                          << " (backlogged " << input.backlogged.load() << ")"
+                          << " (merged " << input.merged.load() << "))";
+        }
+
+    private:
+        void publish(tablet_sample const& sample) noexcept {
+            samples.fetch_add(1, std::memory_order_relaxed);
+            flush();
+            if (backlog_size == 0 && ring.push(sample)) return;
+            if (backlog_size < backlog.size()) {
+                backlog[backlog_size++] = sample;
+                backlogged.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                auto& last = backlog[backlog_size - 1];
+                auto changes = last.flags & (tablet_sample::proximity_changed | tablet_sample::contact_changed);
+                last = sample;
+                last.flags |= changes;
+                merged.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        spsc_ring<tablet_sample, 4096> ring;
+        std::array<tablet_sample, 1024> backlog;
+        size_t backlog_size = 0;
+        std::vector<std::unique_ptr<tool>> tools;
+        std::vector<zwp_tablet_v2*> tablets;
+        std::vector<std::unique_ptr<pad>> pads;
+        std::atomic<uint64_t> events = 0;
+        std::atomic<uint64_t> samples = 0;
+        std::atomic<uint64_t> backlogged = 0;
+        std::atomic<uint64_t> merged = 0;
+    };
+
+    inline zwp_tablet_tool_v2_listener const tablet_tool_listener = {
+        .type = [](auto...) noexcept { },
+        .hardware_serial = [](auto...) noexcept { },
+        .hardware_id_wacom = [](auto...) noexcept { },
+        .capability = [](auto...) noexcept { },
+        .done = [](auto...) noexcept { },
+        .removed = [](auto data, auto) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->remove_tool(*t);
+        },
+        .proximity_in = [](auto data, auto, auto, auto, auto) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::proximity_in, 0, 0, 0 });
+        },
+        .proximity_out = [](auto data, auto) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::proximity_out, 0, 0, 0 });
+        },
+        .down = [](auto data, auto, auto) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::down, 0, 0, 0 });
+        },
+        .up = [](auto data, auto) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::up, 0, 0, 0 });
+        },
+        .motion = [](auto data, auto, auto x, auto y) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::motion, 0,
+                                   static_cast<float>(wl_fixed_to_double(x)),
+                                   static_cast<float>(wl_fixed_to_double(y)) });
+        },
+        .pressure = [](auto data, auto, auto pressure) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::pressure, 0, pressure / 65535.0f, 0 });
+        },
+        .distance = [](auto data, auto, auto distance) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::distance, 0, distance / 65535.0f, 0 });
+        },
+        .tilt = [](auto data, auto, auto x, auto y) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::tilt, 0,
+                                   static_cast<float>(wl_fixed_to_double(x)),
+                                   static_cast<float>(wl_fixed_to_double(y)) });
+        },
+        .rotation = [](auto...) noexcept { },
+        .slider = [](auto...) noexcept { },
+        .wheel = [](auto...) noexcept { },
+        .button = [](auto...) noexcept { },
+        .frame = [](auto data, auto, auto time) noexcept {
+            auto t = static_cast<tablet_input::tool*>(data);
+            t->input->handle(*t, { tablet_event::frame, time, 0, 0 });
+        },
+    };
+    inline zwp_tablet_v2_listener const tablet_device_listener = {
+        .name = [](auto...) noexcept { },
+        .id = [](auto...) noexcept { },
+        .path = [](auto...) noexcept { },
+        .done = [](auto...) noexcept { },
+        .removed = [](auto data, auto proxy) noexcept {
+            static_cast<tablet_input*>(data)->remove_tablet(proxy);
+        },
+    };
+    // Rings and strips carry no new objects of their own, so they can go as soon as they arrive.
+    inline zwp_tablet_pad_group_v2_listener const tablet_pad_group_listener = {
+        .buttons = [](auto...) noexcept { },
+        .ring = [](auto, auto, auto ring) noexcept { zwp_tablet_pad_ring_v2_destroy(ring); },
+        .strip = [](auto, auto, auto strip) noexcept { zwp_tablet_pad_strip_v2_destroy(strip); },
+        .modes = [](auto...) noexcept { },
+        .done = [](auto...) noexcept { },
+        .mode_switch = [](auto...) noexcept { },
+    };
+    inline zwp_tablet_pad_v2_listener const tablet_pad_listener = {
+        .group = [](auto data, auto, auto group) noexcept {
+            auto p = static_cast<tablet_input::pad*>(data);
+            p->groups.push_back(group);
+            zwp_tablet_pad_group_v2_add_listener(group, &tablet_pad_group_listener, p);
+        },
+        .path = [](auto...) noexcept { },
+        .buttons = [](auto...) noexcept { },
+        .done = [](auto...) noexcept { },
+        .button = [](auto...) noexcept { },
+        .enter = [](auto...) noexcept { },
+        .leave = [](auto...) noexcept { },
+        .removed = [](auto data, auto) noexcept {
+            auto p = static_cast<tablet_input::pad*>(data);
+            p->input->remove_pad(*p);
+        },
+    };
+    inline zwp_tablet_seat_v2_listener const tablet_seat_listener = {
+        .tablet_added = [](auto data, auto, auto proxy) noexcept {
+            static_cast<tablet_input*>(data)->add_tablet(proxy);
+            zwp_tablet_v2_add_listener(proxy, &tablet_device_listener, data);
+        },
+        .tool_added = [](auto data, auto, auto proxy) noexcept {
+            auto& t = static_cast<tablet_input*>(data)->add_tool(proxy);
+            zwp_tablet_tool_v2_add_listener(proxy, &tablet_tool_listener, &t);
+        },
+        .pad_added = [](auto data, auto, auto proxy) noexcept {
+            auto& p = static_cast<tablet_input*>(data)->add_pad(proxy);
+            zwp_tablet_pad_v2_add_listener(proxy, &tablet_pad_listener, &p);
+        },
+    };
+
+    // A pen stroke at `rate` Hz: a spiral with varying pressure and tilt, in the same event
+    // shape a compositor sends (proximity, down, axes + frame per report, up, proximity out).
+    inline auto synthesize_stroke(size_t reports, uint32_t rate) {
+        std::vector<tablet_event> events;
+        events.reserve(reports * 4 + 8);
+        events.push_back({ tablet_event::proximity_in, 0, 0, 0 });
+        events.push_back({ tablet_event::frame, 0, 0, 0 });
+        events.push_back({ tablet_event::down, 0, 0, 0 });
+        for (size_t i = 0; i < reports; ++i) {
+            auto const t = static_cast<float>(i) / rate;
+            auto const r = 50.0f + 10.0f * t;
+            events.push_back({ tablet_event::motion, 0, 512 + r * std::cos(t * 6.0f), 384 + r * std::sin(t * 6.0f) });
+            events.push_back({ tablet_event::pressure, 0, 0.5f + 0.5f * std::sin(t * 3.0f), 0 });
+            events.push_back({ tablet_event::tilt, 0, 30.0f * std::cos(t), 30.0f * std::sin(t) });
+            events.push_back({ tablet_event::frame, static_cast<uint32_t>(i * 1000 / rate), 0, 0 });
+        }
+        events.push_back({ tablet_event::up, 0, 0, 0 });
+        events.push_back({ tablet_event::proximity_out, 0, 0, 0 });
+        events.push_back({ tablet_event::frame, static_cast<uint32_t>(reports * 1000 / rate), 0, 0 });
+        return events;
+    }
+} // ::tablet
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.hh"
+
+inline namespace streaming
+{
+    // Staging for everything that goes from the host into device-local buffers and images. Each
+    // frame in flight owns one persistently mapped, host-visible buffer; stage() bump-allocates in
+    // the current frame's buffer and hands back the mapped pointer, so an upload is a memcpy and
+    // an entry in a list. submit() flushes what was written as one nonCoherentAtomSize-widened
+    // range (nothing on coherent memory), records one vkCmdCopyBuffer per destination buffer and
+    // one vkCmdCopyBufferToImage per destination image, and submits on the transfer queue with a
+    // semaphore the consumer's submission waits on.
+    //
+    // Destinations are EXCLUSIVE resources owned by `graphics_family`. When the transfer queue is a
+    // different family, submit() records the release half of the ownership transfer and acquire()
+    // the matching half on the consumer's command buffer; within one family the semaphore alone
+    // orders the copies before their use and acquire() records nothing.
+    //
+    // Images are written from scratch: they go from UNDEFINED to TRANSFER_DST_OPTIMAL before
+    // their copies and to the layout given to stage() afterwards (streamed textures).
+    class upload_ring {
+    public:
+        upload_ring(VkPhysicalDevice physical_device, VkDevice device, device_allocator& allocator,
+                    VkQueue transfer_queue, uint32_t transfer_family, uint32_t graphics_family,
+                    size_t slots, VkDeviceSize slot_size = VkDeviceSize(32) << 20)
+            : device(device),
+              allocator(allocator),
+              queue(transfer_queue),
+              transfer_family(transfer_family),
+              graphics_family(graphics_family),
+              slot_size(slot_size),
+              frames(slots)
+        {
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(physical_device, &props);
+            copy_alignment = std::max<VkDeviceSize>(16, props.limits.optimalBufferCopyOffsetAlignment);
+            try {
+                VkCommandPoolCreateInfo pool_info = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = transfer_family,
+                };
+                if (VK_SUCCESS != vkCreateCommandPool(device, &pool_info, nullptr, &pool)) {
+                    throw std::runtime_error("vkCreateCommandPool failed...");
+                }
+                for (auto& frame : frames) create_frame(frame);
+            }
+            catch (...) {
+                release();
+                throw;
+            }
+            if (!frames.empty()) coherent = allocator.host_coherent(frames.front().memory.memory_type);
+        }
+        upload_ring(upload_ring const&) = delete;
+        upload_ring& operator=(upload_ring const&) = delete;
+        ~upload_ring() { release(); }
+
+        bool dedicated_transfer() const noexcept { return transfer_family != graphics_family; }
+
+        // Before staging anything for the frame that uses `slot`; waits for the slot's last
+        // transfer, which the frame's own fence normally has already covered.
+        void begin_frame(size_t slot) {
+            current = slot;
+            auto& frame = frames[slot];
+            vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+            frame.head = 0;
+            frame.buffer_copies.clear();
+            frame.image_copies.clear();
+        }
+
+        // Room for `size` bytes headed for [offset, offset + size) of `dst`; nullptr when this
+        // frame's buffer is full. The bytes must be written before submit(). Recording the copy
+        // may allocate, so these throw std::bad_alloc like any container.
+        void* stage(VkBuffer dst, VkDeviceSize offset, VkDeviceSize size) {
+            auto src = reserve(size, 16);
+            if (src == no_room) return nullptr;
+            auto& frame = frames[current];
+            frame.buffer_copies.push_back({ dst, { src, offset, size } });
+            return static_cast<char*>(frame.memory.mapped) + src;
+        }
+        bool upload(VkBuffer dst, VkDeviceSize offset, void const* data, VkDeviceSize size) {
+            auto ptr = stage(dst, offset, size);
+            if (ptr) std::memcpy(ptr, data, size);
+            return ptr != nullptr;
+        }
+        // Tightly packed texels for `extent` at `offset` of one subresource of `dst`.
+        void* stage(VkImage dst, VkImageSubresourceLayers subresource, VkOffset3D offset, VkExtent3D extent,
+                    VkDeviceSize size, VkImageLayout final_layout)
+        {
+            auto src = reserve(size, copy_alignment);
+            if (src == no_room) return nullptr;
+            auto& frame = frames[current];
+            frame.image_copies.push_back({ dst, final_layout, { src, 0, 0, subresource, offset, extent } });
+            return static_cast<char*>(frame.memory.mapped) + src;
+        }
+
+        // Records and submits the frame's copies; returns the semaphore the consumer must wait on,
+        // or nullptr when nothing was staged (then there is nothing to wait for or acquire).
+        VkSemaphore submit() {
+            auto& frame = frames[current];
+            released_buffers.clear();
+            released_images.clear();
+            if (frame.buffer_copies.empty() && frame.image_copies.empty()) return nullptr;
+            if (!coherent) {
+                allocator.flush(frame.memory, 0, frame.head);
+                ++flushes;
+            }
+            VkCommandBufferBeginInfo begin = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = nullptr,
+            };
+            auto cmd = frame.command_buffer;
+            vkBeginCommandBuffer(cmd, &begin);
+            record_buffer_copies(cmd, frame);
+            record_image_copies(cmd, frame);
+            vkEndCommandBuffer(cmd);
+
+            vkResetFences(device, 1, &frame.fence);
+            VkSubmitInfo info = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = nullptr,
+                .waitSemaphoreCount = 0,
+                .pWaitSemaphores = nullptr,
+                .pWaitDstStageMask = nullptr,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &cmd,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &frame.done,
+            };
+            if (VK_SUCCESS != vkQueueSubmit(queue, 1, &info, frame.fence)) {
+                throw std::runtime_error("vkQueueSubmit (upload) failed...");
+            }
+            ++submits;
+            bytes += frame.head;
+            return frame.done;
+        }
+
+        // The acquire half for what the last submit() released, recorded on the consumer's
+        // command buffer before first use; `stage`/`access` are where the data is consumed.
+        void acquire(VkCommandBuffer cmd, VkPipelineStageFlags stage, VkAccessFlags buffer_access, VkAccessFlags image_access) const {
+            if (released_buffers.empty() && released_images.empty()) return;
+            auto buffers = released_buffers;
+            for (auto& barrier : buffers) {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = buffer_access;
+            }
+            auto images = released_images;
+            for (auto& barrier : images) {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = image_access;
+            }
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, stage, 0,
+                                 0, nullptr,
+                                 static_cast<uint32_t>(buffers.size()), buffers.data(),
+                                 static_cast<uint32_t>(images.size()), images.data());
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, upload_ring const& ring) noexcept {
+            return output << "(upload-ring"
+                          << " (slots " << ring.frames.size() << ")"
+                          << " (slot-size " << ring.slot_size << ")"
+                          << " (transfer-family " << ring.transfer_family << ")"
+                          << " (dedicated-transfer " << (ring.dedicated_transfer() ? "t" : "nil") << ")"
+                          << " (coherent " << (ring.coherent ? "t" : "nil") << ")"
+                          << " (bytes " << ring.bytes << ")"
+                          << " (submits " << ring.submits << ")"
+                          << " (copy-calls " << ring.copy_calls << ")"
+                          << " (flushes " << ring.flushes << ")"
+                          << " (full " << ring.full << "))";
+        }
+
+    private:
+        struct buffer_copy {
+            VkBuffer dst;
+            VkBufferCopy region;
+        };
+        struct image_copy {
+            VkImage dst;
+            VkImageLayout final_layout;
+            VkBufferImageCopy region;
+        };
+        struct frame_state {
+            VkBuffer buffer = nullptr;
+            allocation memory;
+            VkCommandBuffer command_buffer = nullptr;
+            VkFence fence = nullptr;
+            VkSemaphore done = nullptr;
+            VkDeviceSize head = 0;
+            std::vector<buffer_copy> buffer_copies;
+            std::vector<image_copy> image_copies;
+        };
+
+        static constexpr VkDeviceSize no_room = ~VkDeviceSize(0);
+
+        VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment) noexcept {
+            auto& frame = frames[current];
+            auto const offset = align_up(frame.head, alignment);
+            if (offset + size > slot_size) {
+                ++full;
+                return no_room;
+            }
+            frame.head = offset + size;
+            return offset;
+        }
+
+        void record_buffer_copies(VkCommandBuffer cmd, frame_state& frame) {
+            auto& copies = frame.buffer_copies;
+            std::stable_sort(copies.begin(), copies.end(), [](auto const& a, auto const& b) { return a.dst < b.dst; });
+            std::vector<VkBufferCopy> regions;
+            for (auto first = copies.begin(); first != copies.end(); ) {
+                auto last = std::find_if(first, copies.end(), [&](auto const& c) { return c.dst != first->dst; });
+                regions.clear();
+                for (auto it = first; it != last; ++it) regions.push_back(it->region);
+                vkCmdCopyBuffer(cmd, frame.buffer, first->dst, static_cast<uint32_t>(regions.size()), regions.data());
+                ++copy_calls;
+                if (dedicated_transfer()) {
+                    released_buffers.push_back({
+                        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                        .pNext = nullptr,
+                        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                        .dstAccessMask = 0,
+                        .srcQueueFamilyIndex = transfer_family,
+                        .dstQueueFamilyIndex = graphics_family,
+                        .buffer = first->dst,
+                        .offset = 0,
+                        .size = VK_WHOLE_SIZE,
+                    });
+                }
+                first = last;
+            }
+            if (!released_buffers.empty()) {
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                     0, nullptr, static_cast<uint32_t>(released_buffers.size()), released_buffers.data(), 0, nullptr);
+            }
+        }
+
+        void record_image_copies(VkCommandBuffer cmd, frame_state& frame) {
+            auto& copies = frame.image_copies;
+            if (copies.empty()) return;
+            std::stable_sort(copies.begin(), copies.end(), [](auto const& a, auto const& b) { return a.dst < b.dst; });
+            auto barrier = [](VkImage image, VkImageLayout from, VkImageLayout to) {
+                return VkImageMemoryBarrier {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .pNext = nullptr,
+                    .srcAccessMask = 0,
+                    .dstAccessMask = 0,
+                    .oldLayout = from,
+                    .newLayout = to,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image = image,
+                    .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS },
+                };
+            };
+            std::vector<VkImageMemoryBarrier> to_transfer, after;
+            for (auto first = copies.begin(); first != copies.end(); ) {
+                auto last = std::find_if(first, copies.end(), [&](auto const& c) { return c.dst != first->dst; });
+                auto b = barrier(first->dst, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                b.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                to_transfer.push_back(b);
+                b = barrier(first->dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, first->final_layout);
+                b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                if (dedicated_transfer()) {
+                    b.srcQueueFamilyIndex = transfer_family;
+                    b.dstQueueFamilyIndex = graphics_family;
+                    released_images.push_back(b);
+                }
+                after.push_back(b);
+                first = last;
+            }
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                 0, nullptr, 0, nullptr, static_cast<uint32_t>(to_transfer.size()), to_transfer.data());
+            std::vector<VkBufferImageCopy> regions;
+            for (auto first = copies.begin(); first != copies.end(); ) {
+                auto last = std::find_if(first, copies.end(), [&](auto const& c) { return c.dst != first->dst; });
+                regions.clear();
+                for (auto it = first; it != last; ++it) regions.push_back(it->region);
+                vkCmdCopyBufferToImage(cmd, frame.buffer, first->dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       static_cast<uint32_t>(regions.size()), regions.data());
+                ++copy_calls;
+                first = last;
+            }
+            // the release half when crossing families, else the plain transition to the final layout
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                 0, nullptr, 0, nullptr, static_cast<uint32_t>(after.size()), after.data());
+        }
+
+        void create_frame(frame_state& frame) {
+            VkBufferCreateInfo info = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .size = slot_size,
+                .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr,
+            };
+            if (VK_SUCCESS != vkCreateBuffer(device, &info, nullptr, &frame.buffer)) {
+                throw std::runtime_error("vkCreateBuffer failed...");
+            }
+            // coherent where there is such a type; otherwise submit() flushes what was written
+            frame.memory = allocator.bind(frame.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            if (!frame.memory.mapped) throw std::runtime_error("upload buffer is not mapped...");
+            VkCommandBufferAllocateInfo command_info = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .commandPool = pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+            };
+            if (VK_SUCCESS != vkAllocateCommandBuffers(device, &command_info, &frame.command_buffer)) {
+                throw std::runtime_error("vkAllocateCommandBuffers failed...");
+            }
+            VkFenceCreateInfo fence_info = {
+                .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+            };
+            VkSemaphoreCreateInfo semaphore_info = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+            };
+            if (VK_SUCCESS != vkCreateFence(device, &fence_info, nullptr, &frame.fence) ||
+                VK_SUCCESS != vkCreateSemaphore(device, &semaphore_info, nullptr, &frame.done))
+            {
+                throw std::runtime_error("vkCreateFence/vkCreateSemaphore failed...");
+            }
+        }
+
+        void release() noexcept {
+            for (auto& frame : frames) {
+                if (frame.fence) vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+                if (frame.done) vkDestroySemaphore(device, frame.done, nullptr);
+                if (frame.fence) vkDestroyFence(device, frame.fence, nullptr);
+                if (frame.buffer) vkDestroyBuffer(device, frame.buffer, nullptr);
+                if (frame.memory) allocator.free(frame.memory);
+                frame = { };
+            }
+            if (pool) vkDestroyCommandPool(device, pool, nullptr);
+            pool = nullptr;
+        }
+
+        VkDevice device;
+        device_allocator& allocator;
+        VkQueue queue;
+        uint32_t transfer_family;
+        uint32_t graphics_family;
+        VkDeviceSize slot_size;
+        VkDeviceSize copy_alignment = 16;
+        bool coherent = true;
+        VkCommandPool pool = nullptr;
+        std::vector<frame_state> frames;
+        size_t current = 0;
+        std::vector<VkBufferMemoryBarrier> released_buffers;   // by the last submit(), for acquire()
+        std::vector<VkImageMemoryBarrier> released_images;
+        uint64_t bytes = 0;
+        uint64_t submits = 0;
+        uint64_t copy_calls = 0;
+        uint64_t flushes = 0;
+        uint64_t full = 0;
+    };
+} // ::streaming